@@ -0,0 +1,101 @@
+#include <benchmark/benchmark.h>
+
+#include <vector>
+#include <armspp>
+
+#include "parallel.h"
+
+// Blocked Gibbs sweeps as arms_gibbs() runs them: each block's coordinates are
+// split over the threads, and each coordinate is drawn from a new envelope.
+// The threads either are started for every block, as by parallelFor, or are
+// kept for all the sweeps, as by WorkerTeam. The arguments are the number of
+// threads and of coordinates in each block; compare against one thread for the
+// speedup, which needs as many cores as threads. Starting threads costs most
+// when blocks are small
+
+namespace {
+
+struct LogNormal {
+  double operator()(double x) const {
+    return -x * x / 2;
+  }
+};
+
+const int N_BLOCKS = 4;
+
+// Draws coordinates [begin, end) of a block, each with its own stream
+void drawBlock(
+  std::vector<armspp::Xoshiro256PlusPlus>& rngs,
+  std::vector<double>& x,
+  int begin,
+  int end
+) {
+  const double initial[] = { -5, -1, 1, 5 };
+  LogNormal logPdf;
+  for (int k = begin; k < end; ++k) {
+    armspp::ARMS<double, LogNormal, const double*> dist(
+      logPdf, -10, 10, 0, initial, 4, 16, false, x[k]
+    );
+    x[k] = dist(rngs[k]);
+  }
+}
+
+template<typename Sweep>
+void blockedSweeps(benchmark::State& state, Sweep sweep) {
+  int nCoordinates = N_BLOCKS * static_cast<int>(state.range(1));
+  std::vector<armspp::Xoshiro256PlusPlus> rngs;
+  for (int k = 0; k < nCoordinates; ++k) {
+    rngs.push_back(armspp::Xoshiro256PlusPlus(1, k));
+  }
+  std::vector<double> x(nCoordinates, 0);
+
+  for (auto _ : state) {
+    sweep(rngs, x);
+    benchmark::DoNotOptimize(x.data());
+  }
+  state.counters["updates/s"] = benchmark::Counter(
+    static_cast<double>(state.iterations()) * nCoordinates,
+    benchmark::Counter::kIsRate
+  );
+}
+
+void BM_BlockedSweepsParallelFor(benchmark::State& state) {
+  int nThreads = static_cast<int>(state.range(0));
+  int blockSize = static_cast<int>(state.range(1));
+  blockedSweeps(state, [&](
+    std::vector<armspp::Xoshiro256PlusPlus>& rngs,
+    std::vector<double>& x
+  ) {
+    for (int block = 0; block < N_BLOCKS; ++block) {
+      int offset = block * blockSize;
+      armspp::parallelFor(
+        blockSize, nThreads,
+        [&](int, int begin, int end) {
+          drawBlock(rngs, x, offset + begin, offset + end);
+        }
+      );
+    }
+  });
+}
+BENCHMARK(BM_BlockedSweepsParallelFor)
+  ->ArgsProduct({{1, 2, 4}, {4, 64}})->UseRealTime();
+
+void BM_BlockedSweepsWorkerTeam(benchmark::State& state) {
+  armspp::WorkerTeam team(static_cast<int>(state.range(0)));
+  int blockSize = static_cast<int>(state.range(1));
+  blockedSweeps(state, [&](
+    std::vector<armspp::Xoshiro256PlusPlus>& rngs,
+    std::vector<double>& x
+  ) {
+    for (int block = 0; block < N_BLOCKS; ++block) {
+      int offset = block * blockSize;
+      team.run(blockSize, [&](int, int begin, int end) {
+        drawBlock(rngs, x, offset + begin, offset + end);
+      });
+    }
+  });
+}
+BENCHMARK(BM_BlockedSweepsWorkerTeam)
+  ->ArgsProduct({{1, 2, 4}, {4, 64}})->UseRealTime();
+
+}  // namespace
@@ -0,0 +1,173 @@
+#include <benchmark/benchmark.h>
+
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+#include <armspp>
+
+namespace {
+
+struct LogNormal {
+  double operator()(double x) const {
+    return -x * x / 2;
+  }
+  float operator()(float x) const {
+    return -x * x / 2;
+  }
+};
+
+struct LogStudentT {
+  double operator()(double x) const {
+    return -1.5 * std::log1p(x * x / 2);
+  }
+};
+
+std::vector<double> grid(double lower, double upper, int n) {
+  std::vector<double> output(n);
+  for (int i = 0; i < n; ++i) {
+    output[i] = lower + (i + 1) * (upper - lower) / (n + 1);
+  }
+  return output;
+}
+
+// Draws from an envelope that starts out with max_points points, so every draw
+// works on a hull of the given size
+template<typename Functor>
+void drawsAgainstMaxPoints(
+  benchmark::State& state,
+  double lower,
+  double upper,
+  bool metropolis
+) {
+  int maxPoints = static_cast<int>(state.range(0));
+  int nInitial = (maxPoints - 1) / 2;
+  std::vector<double> initial = grid(lower, upper, nInitial);
+  Functor logPdf;
+  std::mt19937_64 rng(1);
+
+  armspp::ARMS<double, Functor, std::vector<double>::iterator> dist(
+    logPdf, lower, upper, 0,
+    initial.begin(), nInitial,
+    maxPoints, metropolis, 0
+  );
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(dist(rng));
+  }
+  state.counters["draws/s"] = benchmark::Counter(
+    static_cast<double>(state.iterations()),
+    benchmark::Counter::kIsRate
+  );
+}
+
+void BM_NormalDraws(benchmark::State& state) {
+  drawsAgainstMaxPoints<LogNormal>(state, -10, 10, false);
+}
+BENCHMARK(BM_NormalDraws)->RangeMultiplier(4)->Range(16, 4096);
+
+// As above, but drawing through ARMS::sample(rng, first, last), using RNG, to
+// check that filling a range costs no more than calling operator() in a loop
+template<typename RNG>
+void normalBatchDraws(benchmark::State& state) {
+  int maxPoints = static_cast<int>(state.range(0));
+  int nInitial = (maxPoints - 1) / 2;
+  std::vector<double> initial = grid(-10, 10, nInitial);
+  LogNormal logPdf;
+  RNG rng(1);
+
+  armspp::ARMS<double, LogNormal, std::vector<double>::iterator> dist(
+    logPdf, -10, 10, 0,
+    initial.begin(), nInitial,
+    maxPoints, false, 0
+  );
+
+  std::vector<double> samples(1024);
+  for (auto _ : state) {
+    dist.sample(rng, samples.begin(), samples.end());
+    benchmark::DoNotOptimize(samples.data());
+  }
+  state.counters["draws/s"] = benchmark::Counter(
+    static_cast<double>(state.iterations() * samples.size()),
+    benchmark::Counter::kIsRate
+  );
+}
+
+void BM_NormalBatchDraws(benchmark::State& state) {
+  normalBatchDraws<std::mt19937_64>(state);
+}
+BENCHMARK(BM_NormalBatchDraws)->RangeMultiplier(4)->Range(16, 4096);
+
+void BM_NormalBatchDrawsXoshiro(benchmark::State& state) {
+  normalBatchDraws<armspp::Xoshiro256PlusPlus>(state);
+}
+BENCHMARK(BM_NormalBatchDrawsXoshiro)->RangeMultiplier(4)->Range(16, 4096);
+
+// Cost of splitting off a stream for each of many threads or chains
+void BM_StreamConstruction(benchmark::State& state) {
+  uint32_t stream = 0;
+  for (auto _ : state) {
+    std::seed_seq seeds{1u, 0u, stream++};
+    std::mt19937_64 rng(seeds);
+    benchmark::DoNotOptimize(rng());
+  }
+}
+BENCHMARK(BM_StreamConstruction);
+
+void BM_StreamConstructionXoshiro(benchmark::State& state) {
+  armspp::Xoshiro256PlusPlus rng(1);
+  for (auto _ : state) {
+    rng.jump();
+    benchmark::DoNotOptimize(rng());
+  }
+}
+BENCHMARK(BM_StreamConstructionXoshiro);
+
+// Draws once the envelope has converged, so that nearly every proposal is
+// accepted by the squeeze test without evaluating the log density. This is
+// dominated by the cost of inverting the envelope and of the squeeze itself
+template<typename Scalar, typename Math>
+void convergedNormalDraws(benchmark::State& state) {
+  std::vector<Scalar> initial(5);
+  for (int i = 0; i < 5; ++i) {
+    initial[i] = static_cast<Scalar>(-10 + (i + 1) * 20. / 6);
+  }
+  LogNormal logPdf;
+  std::mt19937_64 rng(1);
+
+  armspp::ARMS<
+    Scalar, LogNormal, typename std::vector<Scalar>::iterator, Math
+  > dist(
+    logPdf, -10, 10, 0,
+    initial.begin(), static_cast<int>(initial.size()),
+    static_cast<int>(state.range(0)), false, 0
+  );
+  for (int i = 0; i < 100000; ++i) {
+    dist(rng);
+  }
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(dist(rng));
+  }
+  state.counters["draws/s"] = benchmark::Counter(
+    static_cast<double>(state.iterations()),
+    benchmark::Counter::kIsRate
+  );
+}
+
+void BM_ConvergedNormalDraws(benchmark::State& state) {
+  convergedNormalDraws<double, armspp::StandardMath>(state);
+}
+BENCHMARK(BM_ConvergedNormalDraws)->Arg(25)->Arg(100)->Arg(400);
+
+void BM_ConvergedNormalDrawsFloat(benchmark::State& state) {
+  convergedNormalDraws<float, armspp::StandardMath>(state);
+}
+BENCHMARK(BM_ConvergedNormalDrawsFloat)->Arg(25)->Arg(100)->Arg(400);
+
+void BM_StudentTMetropolisDraws(benchmark::State& state) {
+  drawsAgainstMaxPoints<LogStudentT>(state, -50, 50, true);
+}
+BENCHMARK(BM_StudentTMetropolisDraws)->RangeMultiplier(4)->Range(16, 4096);
+
+}  // namespace
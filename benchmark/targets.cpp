@@ -0,0 +1,451 @@
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+#include <armspp>
+
+// Throughput and adaptation of the sampler on a set of standard targets. Each
+// log density counts its evaluations, so that the number per draw is reported
+// alongside the draw rate
+
+namespace {
+
+struct Normal {
+  static constexpr double LOWER = -10;
+  static constexpr double UPPER = 10;
+  static constexpr bool METROPOLIS = false;
+
+  Normal() : nEvaluations(0) {}
+
+  double operator()(double x) {
+    ++nEvaluations;
+    return -x * x / 2;
+  }
+
+  long nEvaluations;
+};
+
+// Normal with mean 2.5 and standard deviation 0.2, which is narrow compared to
+// the spacing of a grid of initial points
+struct NarrowNormal {
+  static constexpr double LOWER = -10;
+  static constexpr double UPPER = 10;
+  static constexpr bool METROPOLIS = false;
+
+  NarrowNormal() : nEvaluations(0) {}
+
+  double operator()(double x) {
+    ++nEvaluations;
+    return -(x - 2.5) * (x - 2.5) / 0.08;
+  }
+
+  long nEvaluations;
+};
+
+// Gamma with shape 2, log concave and bounded on the left
+struct Gamma {
+  static constexpr double LOWER = 0;
+  static constexpr double UPPER = 100;
+  static constexpr bool METROPOLIS = false;
+
+  Gamma() : nEvaluations(0) {}
+
+  double operator()(double x) {
+    ++nEvaluations;
+    return std::log(x) - x;
+  }
+
+  long nEvaluations;
+};
+
+// Gamma with shape 0.5, which is not log concave near zero
+struct GammaSmallShape {
+  static constexpr double LOWER = 0;
+  static constexpr double UPPER = 100;
+  static constexpr bool METROPOLIS = true;
+
+  GammaSmallShape() : nEvaluations(0) {}
+
+  double operator()(double x) {
+    ++nEvaluations;
+    return -0.5 * std::log(x) - x;
+  }
+
+  long nEvaluations;
+};
+
+// Bimodal mixture of two normals, which is not log concave between the modes
+struct Mixture {
+  static constexpr double LOWER = -20;
+  static constexpr double UPPER = 20;
+  static constexpr bool METROPOLIS = true;
+
+  Mixture() : nEvaluations(0) {}
+
+  double operator()(double x) {
+    ++nEvaluations;
+    double a = std::log(0.4) - (x + 1) * (x + 1) / 2;
+    double b = std::log(0.6) - (x - 4) * (x - 4) / 2;
+    double m = std::max(a, b);
+    return m + std::log(std::exp(a - m) + std::exp(b - m));
+  }
+
+  long nEvaluations;
+};
+
+// The targets above, also providing their gradients so that the envelope is
+// built from tangents
+struct NormalWithGradient : Normal {
+  using Normal::operator();
+
+  double operator()(double x, double& gradient) {
+    gradient = -x;
+    return (*this)(x);
+  }
+};
+
+struct GammaWithGradient : Gamma {
+  using Gamma::operator();
+
+  double operator()(double x, double& gradient) {
+    gradient = 1 / x - 1;
+    return (*this)(x);
+  }
+};
+
+struct MixtureWithGradient : Mixture {
+  using Mixture::operator();
+
+  double operator()(double x, double& gradient) {
+    double y = (*this)(x);
+    double a = std::log(0.4) - (x + 1) * (x + 1) / 2;
+    double b = std::log(0.6) - (x - 4) * (x - 4) / 2;
+    gradient = -(x + 1) * std::exp(a - y) - (x - 4) * std::exp(b - y);
+    return y;
+  }
+};
+
+std::vector<double> grid(double lower, double upper, int n) {
+  std::vector<double> output(n);
+  for (int i = 0; i < n; ++i) {
+    output[i] = lower + (i + 1) * (upper - lower) / (n + 1);
+  }
+  return output;
+}
+
+const int N_INITIAL = 5;
+
+// Draws repeatedly from Target, starting from five initial points and
+// adapting up to max_points points. The envelope converges within the first
+// few iterations, so this mostly measures the adapted sampler. With Pruning,
+// the envelope keeps adapting once it is full
+template<typename Target, typename PruningPolicy = armspp::NoPruning>
+void targetDraws(benchmark::State& state) {
+  int maxPoints = static_cast<int>(state.range(0));
+  std::vector<double> initial = grid(Target::LOWER, Target::UPPER, N_INITIAL);
+  Target logPdf;
+  std::mt19937_64 rng(1);
+
+  armspp::ARMS<
+    double, Target, std::vector<double>::iterator, armspp::StandardMath,
+    armspp::RuntimeMetropolis, armspp::NoDiagnostics, PruningPolicy
+  > dist(
+    logPdf, Target::LOWER, Target::UPPER, 0,
+    initial.begin(), N_INITIAL,
+    maxPoints, Target::METROPOLIS, (Target::LOWER + Target::UPPER) / 2
+  );
+  long nEvaluationsBefore = logPdf.nEvaluations;
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(dist(rng));
+  }
+
+  double nDraws = static_cast<double>(state.iterations());
+  state.counters["draws/s"] = benchmark::Counter(
+    nDraws,
+    benchmark::Counter::kIsRate
+  );
+  state.counters["evals/draw"] = (
+    (logPdf.nEvaluations - nEvaluationsBefore) / nDraws
+  );
+  state.counters["points"] = dist.nPoints();
+}
+
+// The size of the envelope after increasing numbers of draws from a fresh
+// sampler with max_points points, averaged over the iterations
+template<typename Target>
+void targetHullGrowth(benchmark::State& state) {
+  int maxPoints = static_cast<int>(state.range(0));
+  std::vector<double> initial = grid(Target::LOWER, Target::UPPER, N_INITIAL);
+  std::mt19937_64 rng(1);
+  const int CHECKPOINTS[] = { 1, 10, 100, 1000, 10000 };
+  const int N_CHECKPOINTS = sizeof(CHECKPOINTS) / sizeof(CHECKPOINTS[0]);
+  std::vector<double> nPoints(N_CHECKPOINTS, 0);
+  long nEvaluations = 0;
+
+  for (auto _ : state) {
+    Target logPdf;
+    armspp::ARMS<double, Target, std::vector<double>::iterator> dist(
+      logPdf, Target::LOWER, Target::UPPER, 0,
+      initial.begin(), N_INITIAL,
+      maxPoints, Target::METROPOLIS, (Target::LOWER + Target::UPPER) / 2
+    );
+    int nDrawn = 0;
+    for (int k = 0; k < N_CHECKPOINTS; ++k) {
+      for (; nDrawn < CHECKPOINTS[k]; ++nDrawn) {
+        benchmark::DoNotOptimize(dist(rng));
+      }
+      nPoints[k] += dist.nPoints();
+    }
+    nEvaluations += logPdf.nEvaluations;
+  }
+
+  double nIterations = static_cast<double>(state.iterations());
+  for (int k = 0; k < N_CHECKPOINTS; ++k) {
+    state.counters["points@" + std::to_string(CHECKPOINTS[k])] = (
+      nPoints[k] / nIterations
+    );
+  }
+  state.counters["evals/draw"] = (
+    nEvaluations / (nIterations * CHECKPOINTS[N_CHECKPOINTS - 1])
+  );
+}
+
+// The effective sample size of x, by the initial monotone sequence estimator
+// of Geyer (1992)
+double effectiveSampleSize(const std::vector<double>& x) {
+  int n = static_cast<int>(x.size());
+  double mean = 0;
+  for (int t = 0; t < n; ++t) {
+    mean += x[t];
+  }
+  mean /= n;
+  auto autocovariance = [&](int lag) {
+    double sum = 0;
+    for (int t = 0; t + lag < n; ++t) {
+      sum += (x[t] - mean) * (x[t + lag] - mean);
+    }
+    return sum / n;
+  };
+  double variance = autocovariance(0);
+  double time = -1;
+  double previousPair = 2;
+  for (int lag = 0; lag + 1 < n; lag += 2) {
+    double pair = (autocovariance(lag) + autocovariance(lag + 1)) / variance;
+    if (pair <= 0) break;
+    pair = std::min(pair, previousPair);
+    time += 2 * pair;
+    previousPair = pair;
+  }
+  return n / std::max(time, 1. / n);
+}
+
+const int N_MIXING_DRAWS = 20000;
+
+// How well the chain of a fresh sampler with max_points points mixes, as its
+// effective sample size per evaluation of the log density, with the fraction
+// of draws that repeat the previous state after a Metropolis rejection. The
+// number of evaluations per draw alone hides an envelope that lies below the
+// density, which makes the chain stick
+template<typename Target>
+void targetMixing(benchmark::State& state) {
+  int maxPoints = static_cast<int>(state.range(0));
+  std::vector<double> initial = grid(Target::LOWER, Target::UPPER, N_INITIAL);
+  std::mt19937_64 rng(1);
+  std::vector<double> samples(N_MIXING_DRAWS);
+  double ess = 0;
+  long nEvaluations = 0;
+  long nRepeated = 0;
+
+  for (auto _ : state) {
+    Target logPdf;
+    armspp::ARMS<double, Target, std::vector<double>::iterator> dist(
+      logPdf, Target::LOWER, Target::UPPER, 0,
+      initial.begin(), N_INITIAL,
+      maxPoints, Target::METROPOLIS, (Target::LOWER + Target::UPPER) / 2
+    );
+    for (int i = 0; i < N_MIXING_DRAWS; ++i) {
+      samples[i] = dist(rng);
+      if (i > 0 && samples[i] == samples[i - 1]) ++nRepeated;
+    }
+    ess += effectiveSampleSize(samples);
+    nEvaluations += logPdf.nEvaluations;
+  }
+
+  double nDraws = static_cast<double>(state.iterations()) * N_MIXING_DRAWS;
+  state.counters["ess/eval"] = ess / nEvaluations;
+  state.counters["ess/draw"] = ess / nDraws;
+  state.counters["repeated"] = nRepeated / nDraws;
+}
+
+const int N_SET_UP_DRAWS = 10;
+
+// The cost of the first few draws from a new envelope, as when an envelope is
+// rebuilt for every update of a Gibbs sampler. Initial points come from a grid
+// or from bracketInitialPoints, starting at the lower quartile of the interval
+template<typename Target>
+void targetSetUp(benchmark::State& state) {
+  int nInitial = static_cast<int>(state.range(0));
+  bool isBracketed = state.range(1) != 0;
+  std::vector<double> grid = ::grid(Target::LOWER, Target::UPPER, nInitial);
+  double start = 0.75 * Target::LOWER + 0.25 * Target::UPPER;
+  std::mt19937_64 rng(1);
+  long nEvaluations = 0;
+  std::vector<double> x, y, gradient;
+
+  for (auto _ : state) {
+    Target logPdf;
+    if (isBracketed) {
+      armspp::bracketInitialPoints(
+        logPdf, Target::LOWER, Target::UPPER, start, nInitial, x, y, gradient
+      );
+      armspp::ARMS<double, Target, std::vector<double>::iterator> dist(
+        logPdf, Target::LOWER, Target::UPPER, 0,
+        x.begin(), y.begin(), gradient.begin(), static_cast<int>(x.size()),
+        100, Target::METROPOLIS, start
+      );
+      for (int i = 0; i < N_SET_UP_DRAWS; ++i) {
+        benchmark::DoNotOptimize(dist(rng));
+      }
+    } else {
+      armspp::ARMS<double, Target, std::vector<double>::iterator> dist(
+        logPdf, Target::LOWER, Target::UPPER, 0,
+        grid.begin(), nInitial,
+        100, Target::METROPOLIS, start
+      );
+      for (int i = 0; i < N_SET_UP_DRAWS; ++i) {
+        benchmark::DoNotOptimize(dist(rng));
+      }
+    }
+    nEvaluations += logPdf.nEvaluations;
+  }
+
+  state.counters["evals/draw"] = (
+    nEvaluations / (static_cast<double>(state.iterations()) * N_SET_UP_DRAWS)
+  );
+}
+
+// As targetSetUp from a grid, but resetting one sampler for each set of draws
+// rather than constructing a new one, so that its storage is reused
+template<typename Target>
+void targetReset(benchmark::State& state) {
+  int nInitial = static_cast<int>(state.range(0));
+  std::vector<double> grid = ::grid(Target::LOWER, Target::UPPER, nInitial);
+  double start = 0.75 * Target::LOWER + 0.25 * Target::UPPER;
+  std::mt19937_64 rng(1);
+  Target logPdf;
+  armspp::Parameters<double> parameters(
+    Target::LOWER, Target::UPPER, 0, 100, Target::METROPOLIS, start
+  );
+  armspp::ARMS<double, Target, std::vector<double>::iterator> dist(
+    logPdf, parameters, grid.begin(), nInitial
+  );
+  long nEvaluationsBefore = logPdf.nEvaluations;
+
+  for (auto _ : state) {
+    dist.reset(parameters, grid.begin(), nInitial);
+    for (int i = 0; i < N_SET_UP_DRAWS; ++i) {
+      benchmark::DoNotOptimize(dist(rng));
+    }
+  }
+
+  state.counters["evals/draw"] = (
+    (logPdf.nEvaluations - nEvaluationsBefore)
+      / (static_cast<double>(state.iterations()) * N_SET_UP_DRAWS)
+  );
+}
+
+void BM_NormalTarget(benchmark::State& state) {
+  targetDraws<Normal>(state);
+}
+BENCHMARK(BM_NormalTarget)->Arg(16)->Arg(64)->Arg(256);
+
+void BM_GammaTarget(benchmark::State& state) {
+  targetDraws<Gamma>(state);
+}
+BENCHMARK(BM_GammaTarget)->Arg(16)->Arg(64)->Arg(256);
+
+void BM_GammaSmallShapeMetropolisTarget(benchmark::State& state) {
+  targetDraws<GammaSmallShape>(state);
+}
+BENCHMARK(BM_GammaSmallShapeMetropolisTarget)->Arg(16)->Arg(64)->Arg(256);
+
+void BM_MixtureMetropolisTarget(benchmark::State& state) {
+  targetDraws<Mixture>(state);
+}
+BENCHMARK(BM_MixtureMetropolisTarget)->Arg(16)->Arg(64)->Arg(256);
+
+void BM_NormalTangentTarget(benchmark::State& state) {
+  targetDraws<NormalWithGradient>(state);
+}
+BENCHMARK(BM_NormalTangentTarget)->Arg(16)->Arg(64)->Arg(256);
+
+void BM_GammaTangentTarget(benchmark::State& state) {
+  targetDraws<GammaWithGradient>(state);
+}
+BENCHMARK(BM_GammaTangentTarget)->Arg(16)->Arg(64)->Arg(256);
+
+void BM_MixtureMetropolisTangentTarget(benchmark::State& state) {
+  targetDraws<MixtureWithGradient>(state);
+}
+BENCHMARK(BM_MixtureMetropolisTangentTarget)->Arg(16)->Arg(64)->Arg(256);
+
+void BM_MixtureMetropolisMixing(benchmark::State& state) {
+  targetMixing<Mixture>(state);
+}
+BENCHMARK(BM_MixtureMetropolisMixing)->Arg(16)->Arg(100);
+
+void BM_MixtureMetropolisTangentMixing(benchmark::State& state) {
+  targetMixing<MixtureWithGradient>(state);
+}
+BENCHMARK(BM_MixtureMetropolisTangentMixing)->Arg(16)->Arg(100);
+
+void BM_NormalPrunedTarget(benchmark::State& state) {
+  targetDraws<Normal, armspp::Pruning>(state);
+}
+BENCHMARK(BM_NormalPrunedTarget)->Arg(16)->Arg(64)->Arg(256);
+
+void BM_GammaPrunedTarget(benchmark::State& state) {
+  targetDraws<Gamma, armspp::Pruning>(state);
+}
+BENCHMARK(BM_GammaPrunedTarget)->Arg(16)->Arg(64)->Arg(256);
+
+void BM_NormalHullGrowth(benchmark::State& state) {
+  targetHullGrowth<Normal>(state);
+}
+BENCHMARK(BM_NormalHullGrowth)->Arg(64)->Arg(256);
+
+void BM_MixtureMetropolisHullGrowth(benchmark::State& state) {
+  targetHullGrowth<Mixture>(state);
+}
+BENCHMARK(BM_MixtureMetropolisHullGrowth)->Arg(64)->Arg(256);
+
+// Arguments are the number of initial points and whether they are bracketed
+void BM_NarrowNormalSetUp(benchmark::State& state) {
+  targetSetUp<NarrowNormal>(state);
+}
+BENCHMARK(BM_NarrowNormalSetUp)->ArgsProduct({{5, 10}, {0, 1}});
+
+void BM_GammaSetUp(benchmark::State& state) {
+  targetSetUp<Gamma>(state);
+}
+BENCHMARK(BM_GammaSetUp)->ArgsProduct({{5, 10}, {0, 1}});
+
+void BM_MixtureMetropolisSetUp(benchmark::State& state) {
+  targetSetUp<Mixture>(state);
+}
+BENCHMARK(BM_MixtureMetropolisSetUp)->ArgsProduct({{5, 10}, {0, 1}});
+
+void BM_NarrowNormalReset(benchmark::State& state) {
+  targetReset<NarrowNormal>(state);
+}
+BENCHMARK(BM_NarrowNormalReset)->Arg(5)->Arg(10);
+
+void BM_GammaReset(benchmark::State& state) {
+  targetReset<Gamma>(state);
+}
+BENCHMARK(BM_GammaReset)->Arg(5)->Arg(10);
+
+}  // namespace
@@ -6,29 +6,42 @@
 using namespace Rcpp;
 
 // armsGibbs
-RObject armsGibbs(int nSamples, NumericVector previous, Function logPdf, NumericVector lower, NumericVector upper, List initial, NumericVector convex, IntegerVector maxPoints, IntegerVector metropolis, bool includeNEvaluations, bool showProgress);
-RcppExport SEXP _armspp_armsGibbs(SEXP nSamplesSEXP, SEXP previousSEXP, SEXP logPdfSEXP, SEXP lowerSEXP, SEXP upperSEXP, SEXP initialSEXP, SEXP convexSEXP, SEXP maxPointsSEXP, SEXP metropolisSEXP, SEXP includeNEvaluationsSEXP, SEXP showProgressSEXP) {
+RObject armsGibbs(int nSamples, NumericMatrix previous, RObject logPdf, NumericVector lower, NumericVector upper, List initial, NumericVector convex, IntegerVector maxPoints, IntegerVector metropolis, bool warmStart, bool includeNEvaluations, bool includeDiagnostics, bool showProgress, int nThreads, Nullable<List> blocks, int burnIn, int thin, Nullable<Function> callback, Nullable<CharacterVector> outputFile, int chunkSize, Nullable<CharacterVector> checkpointFile, bool resume, bool autoInitial, std::string scan);
+RcppExport SEXP _armspp_armsGibbs(SEXP nSamplesSEXP, SEXP previousSEXP, SEXP logPdfSEXP, SEXP lowerSEXP, SEXP upperSEXP, SEXP initialSEXP, SEXP convexSEXP, SEXP maxPointsSEXP, SEXP metropolisSEXP, SEXP warmStartSEXP, SEXP includeNEvaluationsSEXP, SEXP includeDiagnosticsSEXP, SEXP showProgressSEXP, SEXP nThreadsSEXP, SEXP blocksSEXP, SEXP burnInSEXP, SEXP thinSEXP, SEXP callbackSEXP, SEXP outputFileSEXP, SEXP chunkSizeSEXP, SEXP checkpointFileSEXP, SEXP resumeSEXP, SEXP autoInitialSEXP, SEXP scanSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
     Rcpp::traits::input_parameter< int >::type nSamples(nSamplesSEXP);
-    Rcpp::traits::input_parameter< NumericVector >::type previous(previousSEXP);
-    Rcpp::traits::input_parameter< Function >::type logPdf(logPdfSEXP);
+    Rcpp::traits::input_parameter< NumericMatrix >::type previous(previousSEXP);
+    Rcpp::traits::input_parameter< RObject >::type logPdf(logPdfSEXP);
     Rcpp::traits::input_parameter< NumericVector >::type lower(lowerSEXP);
     Rcpp::traits::input_parameter< NumericVector >::type upper(upperSEXP);
     Rcpp::traits::input_parameter< List >::type initial(initialSEXP);
     Rcpp::traits::input_parameter< NumericVector >::type convex(convexSEXP);
     Rcpp::traits::input_parameter< IntegerVector >::type maxPoints(maxPointsSEXP);
     Rcpp::traits::input_parameter< IntegerVector >::type metropolis(metropolisSEXP);
+    Rcpp::traits::input_parameter< bool >::type warmStart(warmStartSEXP);
     Rcpp::traits::input_parameter< bool >::type includeNEvaluations(includeNEvaluationsSEXP);
+    Rcpp::traits::input_parameter< bool >::type includeDiagnostics(includeDiagnosticsSEXP);
     Rcpp::traits::input_parameter< bool >::type showProgress(showProgressSEXP);
-    rcpp_result_gen = Rcpp::wrap(armsGibbs(nSamples, previous, logPdf, lower, upper, initial, convex, maxPoints, metropolis, includeNEvaluations, showProgress));
+    Rcpp::traits::input_parameter< int >::type nThreads(nThreadsSEXP);
+    Rcpp::traits::input_parameter< Nullable<List> >::type blocks(blocksSEXP);
+    Rcpp::traits::input_parameter< int >::type burnIn(burnInSEXP);
+    Rcpp::traits::input_parameter< int >::type thin(thinSEXP);
+    Rcpp::traits::input_parameter< Nullable<Function> >::type callback(callbackSEXP);
+    Rcpp::traits::input_parameter< Nullable<CharacterVector> >::type outputFile(outputFileSEXP);
+    Rcpp::traits::input_parameter< int >::type chunkSize(chunkSizeSEXP);
+    Rcpp::traits::input_parameter< Nullable<CharacterVector> >::type checkpointFile(checkpointFileSEXP);
+    Rcpp::traits::input_parameter< bool >::type resume(resumeSEXP);
+    Rcpp::traits::input_parameter< bool >::type autoInitial(autoInitialSEXP);
+    Rcpp::traits::input_parameter< std::string >::type scan(scanSEXP);
+    rcpp_result_gen = Rcpp::wrap(armsGibbs(nSamples, previous, logPdf, lower, upper, initial, convex, maxPoints, metropolis, warmStart, includeNEvaluations, includeDiagnostics, showProgress, nThreads, blocks, burnIn, thin, callback, outputFile, chunkSize, checkpointFile, resume, autoInitial, scan));
     return rcpp_result_gen;
 END_RCPP
 }
 // arms
-RObject arms(int nSamples, List logPdf, NumericVector lower, NumericVector upper, List initial, NumericVector convex, IntegerVector maxPoints, IntegerVector metropolis, NumericVector previous, List arguments, bool includeNEvaluations);
-RcppExport SEXP _armspp_arms(SEXP nSamplesSEXP, SEXP logPdfSEXP, SEXP lowerSEXP, SEXP upperSEXP, SEXP initialSEXP, SEXP convexSEXP, SEXP maxPointsSEXP, SEXP metropolisSEXP, SEXP previousSEXP, SEXP argumentsSEXP, SEXP includeNEvaluationsSEXP) {
+RObject arms(int nSamples, List logPdf, NumericVector lower, NumericVector upper, List initial, NumericVector convex, IntegerVector maxPoints, IntegerVector metropolis, NumericVector previous, List arguments, bool includeNEvaluations, bool includeDiagnostics, Nullable<List> envelope, bool includeEnvelope, int nThreads, bool vectorised, bool autoInitial, bool prune);
+RcppExport SEXP _armspp_arms(SEXP nSamplesSEXP, SEXP logPdfSEXP, SEXP lowerSEXP, SEXP upperSEXP, SEXP initialSEXP, SEXP convexSEXP, SEXP maxPointsSEXP, SEXP metropolisSEXP, SEXP previousSEXP, SEXP argumentsSEXP, SEXP includeNEvaluationsSEXP, SEXP includeDiagnosticsSEXP, SEXP envelopeSEXP, SEXP includeEnvelopeSEXP, SEXP nThreadsSEXP, SEXP vectorisedSEXP, SEXP autoInitialSEXP, SEXP pruneSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
@@ -43,14 +56,37 @@ BEGIN_RCPP
     Rcpp::traits::input_parameter< NumericVector >::type previous(previousSEXP);
     Rcpp::traits::input_parameter< List >::type arguments(argumentsSEXP);
     Rcpp::traits::input_parameter< bool >::type includeNEvaluations(includeNEvaluationsSEXP);
-    rcpp_result_gen = Rcpp::wrap(arms(nSamples, logPdf, lower, upper, initial, convex, maxPoints, metropolis, previous, arguments, includeNEvaluations));
+    Rcpp::traits::input_parameter< bool >::type includeDiagnostics(includeDiagnosticsSEXP);
+    Rcpp::traits::input_parameter< Nullable<List> >::type envelope(envelopeSEXP);
+    Rcpp::traits::input_parameter< bool >::type includeEnvelope(includeEnvelopeSEXP);
+    Rcpp::traits::input_parameter< int >::type nThreads(nThreadsSEXP);
+    Rcpp::traits::input_parameter< bool >::type vectorised(vectorisedSEXP);
+    Rcpp::traits::input_parameter< bool >::type autoInitial(autoInitialSEXP);
+    Rcpp::traits::input_parameter< bool >::type prune(pruneSEXP);
+    rcpp_result_gen = Rcpp::wrap(arms(nSamples, logPdf, lower, upper, initial, convex, maxPoints, metropolis, previous, arguments, includeNEvaluations, includeDiagnostics, envelope, includeEnvelope, nThreads, vectorised, autoInitial, prune));
+    return rcpp_result_gen;
+END_RCPP
+}
+// nativeLogPdf
+SEXP nativeLogPdf(std::string package, std::string name, RObject data, bool gibbs, bool gradient);
+RcppExport SEXP _armspp_nativeLogPdf(SEXP packageSEXP, SEXP nameSEXP, SEXP dataSEXP, SEXP gibbsSEXP, SEXP gradientSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::string >::type package(packageSEXP);
+    Rcpp::traits::input_parameter< std::string >::type name(nameSEXP);
+    Rcpp::traits::input_parameter< RObject >::type data(dataSEXP);
+    Rcpp::traits::input_parameter< bool >::type gibbs(gibbsSEXP);
+    Rcpp::traits::input_parameter< bool >::type gradient(gradientSEXP);
+    rcpp_result_gen = Rcpp::wrap(nativeLogPdf(package, name, data, gibbs, gradient));
     return rcpp_result_gen;
 END_RCPP
 }
 
 static const R_CallMethodDef CallEntries[] = {
-    {"_armspp_armsGibbs", (DL_FUNC) &_armspp_armsGibbs, 11},
-    {"_armspp_arms", (DL_FUNC) &_armspp_arms, 11},
+    {"_armspp_armsGibbs", (DL_FUNC) &_armspp_armsGibbs, 24},
+    {"_armspp_arms", (DL_FUNC) &_armspp_arms, 18},
+    {"_armspp_nativeLogPdf", (DL_FUNC) &_armspp_nativeLogPdf, 5},
     {NULL, NULL, 0}
 };
 
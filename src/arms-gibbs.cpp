@@ -1,75 +1,1142 @@
 #include <Rcpp.h>
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <fstream>
+#include <memory>
 #include <random>
+#include <vector>
 #include <armspp>
+#include <armspp_native>
 
+#include "checkpoint.h"
+#include "parallel.h"
 #include "progress.h"
 #include "utils.h"
 
 using namespace Rcpp;
 using armspp::ARMS;
+using armspp::Diagnostics;
+using armspp::NativeGibbsLogPdf;
+using armspp::NativeGibbsLogPdfWithGradient;
+using armspp::NativeGibbsLogPdfWithGradientWrapper;
+using armspp::NativeGibbsLogPdfWrapper;
+using armspp::Parameters;
 using armspp::ProgressBar;
+using armspp::RuntimeMetropolis;
+using armspp::StandardMath;
+using armspp::WorkerTeam;
+using armspp::asNativeGibbsLogPdf;
+using armspp::asNativeGibbsLogPdfWithGradient;
+using armspp::bracketInitialPoints;
+using armspp::diagnosticsToList;
+using armspp::effectiveSampleSize;
+using armspp::hasNativeGradient;
+using armspp::isNativeGibbsLogPdf;
+using armspp::parallelFor;
+using armspp::readBinary;
+using armspp::readGenerator;
+using armspp::readVector;
+using armspp::replaceFile;
+using armspp::writeBinary;
+using armspp::writeGenerator;
+using armspp::writeVector;
+using armspp::streamGenerator;
+using armspp::Xoshiro256PlusPlus;
+
+// Evaluates the full conditional of coordinate dimension() by calling an R
+// function with the current state and the (one-based) coordinate
+class GibbsFunctionWrapper {
+public:
+  GibbsFunctionWrapper(Function logPdf, NumericVector previous)
+    : logPdf_(logPdf),
+      current_(clone(previous)),
+      p_(0),
+      nEvaluations_(0) {}
+
+  double operator()(double x) {
+    current_[p_] = x;
+    ++nEvaluations_;
+    return as<NumericVector>(logPdf_(current_, p_ + 1))[0];
+  }
+
+  double* current() { return current_.begin(); }
+  int dimension() const { return p_; }
+  void setDimension(int p) { p_ = p; }
+  int nEvaluations() const { return nEvaluations_; }
+
+private:
+  Function logPdf_;
+  NumericVector current_;
+  int p_;
+  int nEvaluations_;
+};
+
+// The sampler for a single coordinate
+template<typename Functor>
+using GibbsSampler = ARMS<
+  double, Functor, std::vector<double>::iterator, StandardMath,
+  RuntimeMetropolis, Diagnostics
+>;
+
+// Replaces initial with the same number of evenly spaced quantiles of the
+// envelope of dist. The envelope approximates the full conditional, so these
+// points are usually a better starting point for the next sweep than fixed
+// initial points, and the new envelope needs less adaptation. The points are
+// left unchanged if the quantiles are not usable as initial points
+template<typename Functor>
+void warmStartPoints(
+  GibbsSampler<Functor>& dist,
+  double lower,
+  double upper,
+  std::vector<double>& initial
+) {
+  int n = initial.size();
+  std::vector<double> quantiles(n);
+  for (int k = 0; k < n; ++k) {
+    quantiles[k] = dist.envelopeQuantile(
+      static_cast<double>(k + 1) / static_cast<double>(n + 1)
+    );
+    if (
+      !(quantiles[k] > lower && quantiles[k] < upper)
+      || (k > 0 && !(quantiles[k] > quantiles[k - 1]))
+    ) {
+      return;
+    }
+  }
+  initial.swap(quantiles);
+}
+
+// The order in which a sweep updates the coordinates. A systematic scan
+// updates each in turn. A random scan makes as many updates as there are
+// coordinates, each of a coordinate picked at random; an adaptive scan does
+// the same, but during the burn-in learns to pick the coordinates that mix
+// slowly more often. Its probabilities are fixed once the burn-in ends, so
+// the chain kept afterwards has the target as its stationary distribution
+enum class Scan {
+  SYSTEMATIC,
+  RANDOM,
+  ADAPTIVE
+};
+
+// Settings for each coordinate, copied out of the R objects so that chains
+// can run without the R API
+struct GibbsSettings {
+  GibbsSettings(
+    int nDimensions,
+    NumericVector lower, NumericVector upper,
+    List initial,
+    NumericVector convex,
+    IntegerVector maxPoints,
+    IntegerVector metropolis,
+    bool warmStart_,
+    bool autoInitial_,
+    Nullable<List> blocks_,
+    Scan scan_
+  ) : warmStart(warmStart_),
+      autoInitial(autoInitial_),
+      scan(scan_) {
+    if (blocks_.isNotNull()) {
+      List blocksList(blocks_.get());
+      std::vector<int> nTimesSeen(nDimensions, 0);
+      for (int block = 0; block < blocksList.size(); ++block) {
+        IntegerVector blockVector = blocksList[block];
+        for (int k = 0; k < blockVector.size(); ++k) {
+          if (blockVector[k] < 0 || blockVector[k] >= nDimensions) {
+            stop("Invalid coordinate in blocks");
+          }
+          ++nTimesSeen[blockVector[k]];
+        }
+        blocks.push_back(std::vector<int>(
+          blockVector.begin(), blockVector.end()
+        ));
+      }
+      for (int p = 0; p < nDimensions; ++p) {
+        if (nTimesSeen[p] != 1) {
+          stop("Each coordinate must be in exactly one block");
+        }
+      }
+    }
+
+    for (int p = 0; p < nDimensions; ++p) {
+      NumericVector initialVector = initial[p % initial.size()];
+      initialPoints.push_back(std::vector<double>(
+        initialVector.begin(), initialVector.end()
+      ));
+      lowerValues.push_back(lower[p % lower.size()]);
+      upperValues.push_back(upper[p % upper.size()]);
+      convexValues.push_back(convex[p % convex.size()]);
+      maxPointsValues.push_back(maxPoints[p % maxPoints.size()]);
+      metropolisValues.push_back(metropolis[p % metropolis.size()]);
+    }
+  }
+
+  std::vector<std::vector<double> > initialPoints;
+  std::vector<double> lowerValues;
+  std::vector<double> upperValues;
+  std::vector<double> convexValues;
+  std::vector<int> maxPointsValues;
+  std::vector<int> metropolisValues;
+  bool warmStart;
+  // Whether the initial points are chosen around the mode of each full
+  // conditional, rather than taken from initialPoints. The search starts from
+  // the current value, or with Metropolis steps from the median of
+  // initialPoints
+  bool autoInitial;
+  // Coordinates of each block, in the order the blocks are updated; empty if
+  // coordinates are updated one at a time
+  std::vector<std::vector<int> > blocks;
+  Scan scan;
+};
+
+// Makes dist a sampler for logPdf with the given parameters and initial
+// points: on first use it is constructed, and after that it is reset, so that
+// its storage is reused from one draw to the next
+template<typename Functor>
+void resetSampler(
+  std::unique_ptr<GibbsSampler<Functor> >& dist,
+  Functor& logPdf,
+  const Parameters<double>& parameters,
+  std::vector<double>::iterator xInitial,
+  int nInitial
+) {
+  if (dist) {
+    dist->reset(parameters, xInitial, nInitial);
+  } else {
+    dist.reset(new GibbsSampler<Functor>(
+      logPdf, parameters, xInitial, nInitial
+    ));
+  }
+}
+
+// As above, with the log density and its gradient at the initial points given
+// by yInitial and gradientInitial
+template<typename Functor>
+void resetSampler(
+  std::unique_ptr<GibbsSampler<Functor> >& dist,
+  Functor& logPdf,
+  const Parameters<double>& parameters,
+  std::vector<double>::iterator xInitial,
+  std::vector<double>::iterator yInitial,
+  std::vector<double>::iterator gradientInitial,
+  int nInitial
+) {
+  if (dist) {
+    dist->reset(parameters, xInitial, yInitial, gradientInitial, nInitial);
+  } else {
+    dist.reset(new GibbsSampler<Functor>(
+      logPdf, parameters, xInitial, yInitial, gradientInitial, nInitial
+    ));
+  }
+}
+
+// Draws a new value of coordinate p given logPdf.current(), updating initial
+// if warm starting and adding the counts of the sampler to diagnostics. dist
+// holds the sampler for logPdf, as kept by resetSampler
+template<typename Functor, typename RNG>
+double sampleCoordinate(
+  Functor& logPdf,
+  std::unique_ptr<GibbsSampler<Functor> >& dist,
+  RNG& rng,
+  int p,
+  const GibbsSettings& settings,
+  std::vector<double>& initial,
+  Diagnostics& diagnostics
+) {
+  double lower = settings.lowerValues[p];
+  double upper = settings.upperValues[p];
+  double previous = logPdf.current()[p];
+  Parameters<double> parameters(
+    lower,
+    upper,
+    settings.convexValues[p],
+    settings.maxPointsValues[p],
+    settings.metropolisValues[p],
+    previous
+  );
+
+  logPdf.setDimension(p);
+  if (settings.autoInitial) {
+    // With Metropolis steps the envelope is the proposal, which must not
+    // depend on the current value, so the search starts from a fixed point
+    int n = initial.size();
+    double start = settings.metropolisValues[p]
+      ? (initial[(n - 1) / 2] + initial[n / 2]) / 2
+      : previous;
+    std::vector<double> x, y, gradient;
+    bracketInitialPoints(logPdf, lower, upper, start, n, x, y, gradient);
+    resetSampler(
+      dist, logPdf, parameters,
+      x.begin(), y.begin(), gradient.begin(), x.size()
+    );
+    double sample = (*dist)(rng);
+    diagnostics += dist->diagnostics();
+    return sample;
+  }
+
+  resetSampler(dist, logPdf, parameters, initial.begin(), initial.size());
+  double x = (*dist)(rng);
+  diagnostics += dist->diagnostics();
+
+  if (settings.warmStart) {
+    warmStartPoints(*dist, lower, upper, initial);
+  }
+  return x;
+}
+
+// The state of one chain. Each of its log densities, one per thread used
+// within the chain, holds its own copy of the current state
+template<typename Functor>
+class GibbsChain {
+public:
+  GibbsChain(
+    const std::vector<Functor>& logPdfs,
+    const Xoshiro256PlusPlus& rng,
+    int nDimensions,
+    const GibbsSettings& settings
+  ) : logPdfs_(logPdfs),
+      samplers_(logPdfs.size()),
+      rng_(rng),
+      settings_(settings),
+      nDimensions_(nDimensions),
+      nextInitial_(settings.initialPoints),
+      next_(nDimensions),
+      diagnostics_(nDimensions) {
+    if (!settings_.blocks.empty()) {
+      // Each coordinate has its own stream, so that coordinates within a
+      // block can be drawn in any order. These are split from the chain's own
+      // stream by jumps, so none of them overlap
+      Xoshiro256PlusPlus stream = rng;
+      rngs_.reserve(nDimensions);
+      for (int p = 0; p < nDimensions; ++p) {
+        stream.jump();
+        rngs_.push_back(stream);
+      }
+    }
+    if (settings_.scan != Scan::SYSTEMATIC) {
+      // Start with every coordinate equally likely
+      scanCumulative_.resize(nDimensions);
+      for (int p = 0; p < nDimensions; ++p) {
+        scanCumulative_[p] = static_cast<double>(p + 1) / nDimensions;
+      }
+    }
+    if (settings_.scan == Scan::ADAPTIVE) {
+      nUpdates_.resize(nDimensions, 0);
+      means_.resize(nDimensions, 0);
+      sumsOfSquares_.resize(nDimensions, 0);
+      sumsOfSquaredJumps_.resize(nDimensions, 0);
+    }
+  }
+
+  // Performs nSweeps sweeps, calling progress() after each. If output is not
+  // NULL, every thin-th state is kept, with coordinate p of the ith kept state
+  // written to output[i + p * stride]. During the burn-in, an adaptive scan
+  // revises its probabilities after each sweep
+  template<typename Progress>
+  void sample(
+    int nSweeps,
+    int thin,
+    double* output,
+    int stride,
+    bool isBurnIn,
+    Progress& progress
+  ) {
+    // The threads for the blocks are started once for all the sweeps
+    WorkerTeam team(settings_.blocks.empty() ? 1 : logPdfs_.size());
+    for (int j = 0; j < nSweeps; ++j) {
+      if (!settings_.blocks.empty()) {
+        sweepBlocks_(team);
+      } else if (settings_.scan == Scan::SYSTEMATIC) {
+        sweep_();
+      } else {
+        randomSweep_(isBurnIn && settings_.scan == Scan::ADAPTIVE);
+      }
+      progress();
+
+      if (output != NULL && (j + 1) % thin == 0) {
+        const double* current = logPdfs_[0].current();
+        int i = j / thin;
+        for (int p = 0; p < nDimensions_; ++p) {
+          output[i + static_cast<long>(p) * stride] = current[p];
+        }
+      }
+    }
+  }
+
+  // Writes the state of the chain: its generators, the current state, the
+  // warm start points of each coordinate, and the state of a random scan
+  void save(std::ostream& stream) {
+    writeGenerator(stream, rng_);
+    writeBinary<int32_t>(stream, rngs_.size());
+    for (std::size_t p = 0; p < rngs_.size(); ++p) {
+      writeGenerator(stream, rngs_[p]);
+    }
+    const double* current = logPdfs_[0].current();
+    writeVector(stream, std::vector<double>(current, current + nDimensions_));
+    for (int p = 0; p < nDimensions_; ++p) {
+      writeVector(stream, nextInitial_[p]);
+    }
+    writeVector(stream, scanCumulative_);
+    writeVector(stream, nUpdates_);
+    writeVector(stream, means_);
+    writeVector(stream, sumsOfSquares_);
+    writeVector(stream, sumsOfSquaredJumps_);
+  }
+
+  // Restores the state written by save
+  void load(std::istream& stream) {
+    readGenerator(stream, rng_);
+    if (readBinary<int32_t>(stream) != static_cast<int32_t>(rngs_.size())) {
+      stop("Checkpoint does not match the blocks given");
+    }
+    for (std::size_t p = 0; p < rngs_.size(); ++p) {
+      readGenerator(stream, rngs_[p]);
+    }
+    std::vector<double> current = readVector(stream);
+    if (static_cast<int>(current.size()) != nDimensions_) {
+      stop("Checkpoint does not match the number of coordinates");
+    }
+    for (std::size_t k = 0; k < logPdfs_.size(); ++k) {
+      std::copy(current.begin(), current.end(), logPdfs_[k].current());
+    }
+    for (int p = 0; p < nDimensions_; ++p) {
+      std::vector<double> initial = readVector(stream);
+      if (initial.size() != nextInitial_[p].size()) {
+        stop("Checkpoint does not match the initial points given");
+      }
+      nextInitial_[p].swap(initial);
+    }
+    loadScanVector_(stream, scanCumulative_);
+    loadScanVector_(stream, nUpdates_);
+    loadScanVector_(stream, means_);
+    loadScanVector_(stream, sumsOfSquares_);
+    loadScanVector_(stream, sumsOfSquaredJumps_);
+  }
+
+  int nDimensions() const { return nDimensions_; }
+
+  int nEvaluations() const {
+    int total = 0;
+    for (std::size_t k = 0; k < logPdfs_.size(); ++k) {
+      total += logPdfs_[k].nEvaluations();
+    }
+    return total;
+  }
+
+  // The counts of the sampler for each coordinate
+  const std::vector<Diagnostics>& diagnostics() const { return diagnostics_; }
+
+private:
+  std::vector<Functor> logPdfs_;
+  // The sampler for each log density, made on first use and then reset for
+  // each coordinate it updates
+  std::vector<std::unique_ptr<GibbsSampler<Functor> > > samplers_;
+  Xoshiro256PlusPlus rng_;
+  std::vector<Xoshiro256PlusPlus> rngs_;
+  const GibbsSettings& settings_;
+  int nDimensions_;
+  // The initial points for each coordinate in the next sweep
+  std::vector<std::vector<double> > nextInitial_;
+  std::vector<double> next_;
+  std::vector<Diagnostics> diagnostics_;
+  // The cumulative probabilities with which a random scan picks each
+  // coordinate; empty for a systematic scan
+  std::vector<double> scanCumulative_;
+  // What an adaptive scan has seen of each coordinate during the burn-in: the
+  // number of updates, the running mean and sum of squared deviations of the
+  // values drawn (as in Welford's method), and the sum of the squared jumps
+  // from the value before each update
+  std::vector<double> nUpdates_;
+  std::vector<double> means_;
+  std::vector<double> sumsOfSquares_;
+  std::vector<double> sumsOfSquaredJumps_;
+  std::uniform_real_distribution<double> uniform_;
+
+  // Updates needed of every coordinate before an adaptive scan moves away
+  // from equal probabilities, and the mixing rate below which coordinates get
+  // no more updates
+  static const int MIN_ADAPTIVE_UPDATES = 10;
+  static constexpr double MIN_MIXING_RATE = 0.01;
+
+  void sweep_() {
+    Functor& logPdf = logPdfs_[0];
+    double* current = logPdf.current();
+    for (int p = 0; p < nDimensions_; ++p) {
+      current[p] = sampleCoordinate(
+        logPdf, samplers_[0], rng_,
+        p, settings_, nextInitial_[p], diagnostics_[p]
+      );
+    }
+  }
+
+  // Makes as many updates as there are coordinates, each of a coordinate
+  // picked with the probabilities in scanCumulative_. If adapt, the updates
+  // are recorded and the probabilities then revised
+  void randomSweep_(bool adapt) {
+    Functor& logPdf = logPdfs_[0];
+    double* current = logPdf.current();
+    for (int k = 0; k < nDimensions_; ++k) {
+      // Searching all but the last entry leaves the last coordinate for any
+      // uniform beyond the others, despite rounding in the cumulative sums
+      int p = std::upper_bound(
+        scanCumulative_.begin(), scanCumulative_.end() - 1, uniform_(rng_)
+      ) - scanCumulative_.begin();
+      double previous = current[p];
+      current[p] = sampleCoordinate(
+        logPdf, samplers_[0], rng_,
+        p, settings_, nextInitial_[p], diagnostics_[p]
+      );
+      if (adapt) {
+        nUpdates_[p] += 1;
+        double deviation = current[p] - means_[p];
+        means_[p] += deviation / nUpdates_[p];
+        sumsOfSquares_[p] += deviation * (current[p] - means_[p]);
+        double jump = current[p] - previous;
+        sumsOfSquaredJumps_[p] += jump * jump;
+      }
+    }
+    if (adapt) {
+      adaptScan_();
+    }
+  }
+
+  // Makes the probability of picking each coordinate inversely proportional
+  // to its mixing rate: its mean squared jump per update over twice its
+  // variance, which is one minus the autocorrelation between its values before
+  // and after an update. Half of the probability is always spread evenly, so
+  // that no coordinate is neglected
+  void adaptScan_() {
+    for (int p = 0; p < nDimensions_; ++p) {
+      if (nUpdates_[p] < MIN_ADAPTIVE_UPDATES) return;
+    }
+    double total = 0;
+    for (int p = 0; p < nDimensions_; ++p) {
+      double rate = sumsOfSquares_[p] > 0
+        ? sumsOfSquaredJumps_[p] / (2 * sumsOfSquares_[p])
+        : 1;
+      if (rate < MIN_MIXING_RATE) rate = MIN_MIXING_RATE;
+      if (rate > 1) rate = 1;
+      scanCumulative_[p] = 1 / rate;
+      total += scanCumulative_[p];
+    }
+    double cumulative = 0;
+    for (int p = 0; p < nDimensions_; ++p) {
+      cumulative += 0.5 * scanCumulative_[p] / total + 0.5 / nDimensions_;
+      scanCumulative_[p] = cumulative;
+    }
+  }
+
+  static void loadScanVector_(std::istream& stream, std::vector<double>& x) {
+    std::vector<double> saved = readVector(stream);
+    if (saved.size() != x.size()) {
+      stop("Checkpoint does not match the scan given");
+    }
+    x.swap(saved);
+  }
+
+  // Updates settings.blocks in turn. The coordinates in a block are
+  // conditionally independent given the rest, so they are all drawn given the
+  // state at the start of the block, split over the team's threads
+  void sweepBlocks_(WorkerTeam& team) {
+    int nThreads = logPdfs_.size();
+    for (std::size_t block = 0; block < settings_.blocks.size(); ++block) {
+      const std::vector<int>& coordinates = settings_.blocks[block];
+      int nCoordinates = coordinates.size();
+      team.run(nCoordinates, [&](int thread, int begin, int end) {
+        Functor& logPdf = logPdfs_[thread];
+        double* current = logPdf.current();
+        for (int k = begin; k < end; ++k) {
+          int p = coordinates[k];
+          double previous = current[p];
+          next_[p] = sampleCoordinate(
+            logPdf, samplers_[thread], rngs_[p],
+            p, settings_, nextInitial_[p], diagnostics_[p]
+          );
+          // Other coordinates in the block are drawn given the old value
+          current[p] = previous;
+        }
+      });
+
+      for (int thread = 0; thread < nThreads; ++thread) {
+        double* current = logPdfs_[thread].current();
+        for (int k = 0; k < nCoordinates; ++k) {
+          current[coordinates[k]] = next_[coordinates[k]];
+        }
+      }
+    }
+  }
+};
+
+// Runs the chains over nThreads threads, first discarding burnIn sweeps and
+// then keeping nSamples states, thin sweeps apart, in chunks of chunkSize.
+// The buffer holds bufferLength states for each chain, stored by iteration,
+// then chain, then coordinate; if that is enough for all the samples, each
+// chunk is stored in place, and otherwise at the start. After each chunk,
+// flush(first, n, chunk) is called on the calling thread with the index of the
+// first state in the chunk, the number of states in it, and where it starts.
+// Then checkpoint(nBurnIn, nKept) is called with the number of sweeps of the
+// burn-in and the number of states kept so far; the burn-in is also split
+// into checkpointed chunks of burnInChunk sweeps.
+template<
+  typename Functor,
+  typename Progress,
+  typename Wait,
+  typename Flush,
+  typename Checkpoint
+>
+void runChains(
+  std::vector<GibbsChain<Functor> >& chains,
+  int nThreads,
+  int burnIn,
+  int nSamples,
+  int thin,
+  int chunkSize,
+  int burnInChunk,
+  double* buffer,
+  int bufferLength,
+  Progress& progress,
+  Wait wait,
+  Flush& flush,
+  Checkpoint& checkpoint
+) {
+  int nChains = chains.size();
+  for (int first = 0; first < burnIn; first += burnInChunk) {
+    int n = std::min(burnInChunk, burnIn - first);
+    parallelFor(nChains, nThreads, [&](int thread, int begin, int end) {
+      for (int chain = begin; chain < end; ++chain) {
+        chains[chain].sample(n, 1, NULL, 0, true, progress);
+      }
+    }, wait);
+    checkpoint(first + n, 0);
+  }
+
+  for (int first = 0; first < nSamples; first += chunkSize) {
+    int n = std::min(chunkSize, nSamples - first);
+    double* chunk = bufferLength >= nSamples ? buffer + first : buffer;
+    parallelFor(nChains, nThreads, [&](int thread, int begin, int end) {
+      for (int chain = begin; chain < end; ++chain) {
+        chains[chain].sample(
+          n * thin, thin,
+          chunk + static_cast<long>(bufferLength) * chain,
+          bufferLength * nChains,
+          false,
+          progress
+        );
+      }
+    }, wait);
+    flush(first, n, chunk);
+    checkpoint(burnIn, first + n);
+  }
+}
+
+const char CHECKPOINT_MAGIC[8] = { 'A', 'R', 'M', 'S', 'P', 'P', 'C', 'K' };
+const int32_t CHECKPOINT_VERSION = 4;
+
+// Restores the chains from resumeFile if it is open, then runs them as in
+// runChains, writing a checkpoint to checkpointFile (if not NULL) after each
+// chunk. Along with the state of the chains, the checkpoint records the
+// settings that decide which sweeps are kept, so that a run is not resumed
+// with different ones. The checkpoint is written to a temporary file that then replaces the
+// old one, so an interrupted write leaves the last checkpoint intact
+template<typename Functor, typename Progress, typename Wait, typename Flush>
+void runGibbs(
+  std::vector<GibbsChain<Functor> >& chains,
+  int nThreads,
+  std::ifstream& resumeFile,
+  Nullable<CharacterVector> checkpointFile,
+  int nBurnInDone,
+  int nBurnIn,
+  int nSamplesDone,
+  int nSamples,
+  int thin,
+  int chunkSize,
+  int burnInChunk,
+  double* buffer,
+  int bufferLength,
+  Progress& progress,
+  Wait wait,
+  Flush& flush
+) {
+  if (resumeFile.is_open()) {
+    for (std::size_t chain = 0; chain < chains.size(); ++chain) {
+      chains[chain].load(resumeFile);
+    }
+    resumeFile.close();
+  }
+
+  std::string path;
+  if (checkpointFile.isNotNull()) {
+    path = as<std::string>(checkpointFile.get());
+  }
+  auto checkpoint = [&](int nBurnInRun, int nSamplesRun) {
+    if (path.empty()) return;
+    std::string temporaryPath = path + ".tmp";
+    {
+      std::ofstream stream(
+        temporaryPath.c_str(),
+        std::ios::out | std::ios::binary | std::ios::trunc
+      );
+      stream.write(CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+      writeBinary<int32_t>(stream, CHECKPOINT_VERSION);
+      writeBinary<int32_t>(stream, chains.size());
+      writeBinary<int32_t>(stream, chains.empty() ? 0 : chains[0].nDimensions());
+      writeBinary<int32_t>(stream, nBurnInDone + nBurnIn);
+      writeBinary<int32_t>(stream, thin);
+      writeBinary<int32_t>(stream, chunkSize);
+      writeBinary<int32_t>(stream, nBurnInDone + nBurnInRun);
+      writeBinary<int32_t>(stream, nSamplesDone + nSamplesRun);
+      for (std::size_t chain = 0; chain < chains.size(); ++chain) {
+        chains[chain].save(stream);
+      }
+      if (!stream) {
+        stop("Failed to write checkpoint to %s", temporaryPath);
+      }
+    }
+    if (!replaceFile(temporaryPath, path)) {
+      stop("Failed to replace checkpoint %s", path);
+    }
+  };
+
+  runChains(
+    chains, nThreads, nBurnIn, nSamples, thin, chunkSize, burnInChunk,
+    buffer, bufferLength, progress, wait, flush, checkpoint
+  );
+}
+
+// Gives the samples the shape returned to R: a matrix for one chain, and
+// otherwise an array indexed by iteration, chain, and coordinate
+void setSampleDimensions(
+  NumericVector samples,
+  int nSamples,
+  int nChains,
+  int nDimensions,
+  RObject names
+) {
+  if (nChains == 1) {
+    samples.attr("dim") = Dimension(nSamples, nDimensions);
+    if (!Rf_isNull(names)) {
+      samples.attr("dimnames") = List::create(R_NilValue, names);
+    }
+  } else {
+    samples.attr("dim") = Dimension(nSamples, nChains, nDimensions);
+    if (!Rf_isNull(names)) {
+      samples.attr("dimnames") = List::create(R_NilValue, R_NilValue, names);
+    }
+  }
+}
+
+// Makes one chain per row of previous for a native log density, wrapped by
+// Wrapper, with nThreadsPerChain copies of the wrapper for each chain
+template<typename Wrapper, typename Native>
+std::vector<GibbsChain<Wrapper> > makeNativeChains(
+  Native native,
+  NumericMatrix previous,
+  int nThreadsPerChain,
+  const Xoshiro256PlusPlus& rng,
+  uint_fast64_t seed,
+  const GibbsSettings& settings
+) {
+  int nChains = previous.nrow();
+  int nDimensions = previous.ncol();
+  std::vector<GibbsChain<Wrapper> > chains;
+  chains.reserve(nChains);
+  for (int chain = 0; chain < nChains; ++chain) {
+    std::vector<double> previousValues(nDimensions);
+    for (int p = 0; p < nDimensions; ++p) {
+      previousValues[p] = previous(chain, p);
+    }
+    chains.push_back(GibbsChain<Wrapper>(
+      std::vector<Wrapper>(
+        nThreadsPerChain,
+        Wrapper(native, previousValues.data(), nDimensions)
+      ),
+      nChains > 1 ? streamGenerator(seed, chain) : rng,
+      nDimensions, settings
+    ));
+  }
+  return chains;
+}
+
+// The number of sweeps in each chunk of a burn-in of burnIn sweeps. A run
+// that is chunked, because it streams or checkpoints, splits its burn-in into
+// chunks of chunkSize * thin sweeps, as for the states kept; otherwise the
+// burn-in needs no chunks, and is done in one
+static int burnInChunk(int burnIn, int thin, int chunkSize, bool isChunked) {
+  if (!isChunked) {
+    return std::max(burnIn, 1);
+  }
+  return static_cast<int>(std::min<long>(
+    static_cast<long>(chunkSize) * thin,
+    INT_MAX
+  ));
+}
 
 // [[Rcpp::export(name = '.arms_gibbs')]]
 RObject armsGibbs(
   int nSamples,
-  NumericVector previous,
-  Function logPdf,
+  NumericMatrix previous,
+  RObject logPdf,
   NumericVector lower, NumericVector upper,
   List initial,
   NumericVector convex,
   IntegerVector maxPoints,
   IntegerVector metropolis,
+  bool warmStart,
   bool includeNEvaluations,
-  bool showProgress
+  bool includeDiagnostics,
+  bool showProgress,
+  int nThreads,
+  Nullable<List> blocks,
+  int burnIn,
+  int thin,
+  Nullable<Function> callback,
+  Nullable<CharacterVector> outputFile,
+  int chunkSize,
+  Nullable<CharacterVector> checkpointFile,
+  bool resume,
+  bool autoInitial,
+  std::string scan
 ) {
-  std::mt19937_64 rng(static_cast<uint_fast64_t>(UINT_FAST64_MAX * R::unif_rand()));
-  int nDimensions = previous.size();
+  Xoshiro256PlusPlus rng(static_cast<uint_fast64_t>(UINT_FAST64_MAX * R::unif_rand()));
+  int nChains = previous.nrow();
+  int nDimensions = previous.ncol();
+  bool isNative = isNativeGibbsLogPdf(logPdf);
+  if (nChains < 1) {
+    stop("At least one chain is required");
+  }
+  if (nThreads < 1) {
+    stop("n_threads must be at least 1");
+  }
+  if (nThreads > 1 && !isNative) {
+    stop("Multiple threads can only be used with a native log density");
+  }
+  if (burnIn < 0 || thin < 1 || chunkSize < 1) {
+    stop("burn_in must be non-negative, and thin and chunk_size positive");
+  }
+  // Sweeps are counted in an int, in every chunk as well as in total
+  if (static_cast<double>(nSamples) * thin > INT_MAX) {
+    stop("n_samples * thin must be at most .Machine$integer.max");
+  }
+  if (warmStart && autoInitial) {
+    stop("warm_start and auto_initial cannot both be used");
+  }
+  // The envelope of the previous sweep depends on the state it was built
+  // from, so initial points taken from it would make the proposal of a
+  // Metropolis step depend on the current state
+  if (warmStart) {
+    for (int k = 0; k < metropolis.size(); ++k) {
+      if (metropolis[k]) {
+        stop("warm_start can only be used with metropolis = FALSE");
+      }
+    }
+  }
 
-  NumericMatrix samples(nSamples, nDimensions);
-  NumericVector current(clone(previous));
-  int nEvaluations = 0;
-  int p;
-  auto logPdfLambda = [&](double x) -> double {
-    current[p] = x;
-    ++nEvaluations;
-    return as<NumericVector>(logPdf(current, p + 1))[0];
-  };
+  Scan scanValue;
+  if (scan == "systematic") {
+    scanValue = Scan::SYSTEMATIC;
+  } else if (scan == "random") {
+    scanValue = Scan::RANDOM;
+  } else if (scan == "adaptive") {
+    scanValue = Scan::ADAPTIVE;
+  } else {
+    stop("scan must be one of 'systematic', 'random' or 'adaptive'");
+  }
 
-  ProgressBar pb(nSamples);
+  GibbsSettings settings(
+    nDimensions, lower, upper, initial, convex, maxPoints, metropolis,
+    warmStart, autoInitial, blocks, scanValue
+  );
+  bool isBlocked = !settings.blocks.empty();
+  if (isBlocked && scanValue != Scan::SYSTEMATIC) {
+    stop("Blocks can only be updated by a systematic scan");
+  }
 
-  for (int i = 0; i < nSamples; ++i) {
-    for (p = 0; p < nDimensions; ++p) {
-      NumericVector initialVector = initial[p % initial.size()];
+  // When resuming from an existing checkpoint, the chains continue from it,
+  // and only the remaining sweeps are run
+  int nBurnInDone = 0;
+  int nSamplesDone = 0;
+  std::ifstream resumeFile;
+  if (resume && checkpointFile.isNull()) {
+    stop("resume requires checkpoint_file");
+  }
+  if (resume) {
+    std::string path = as<std::string>(checkpointFile.get());
+    resumeFile.open(path.c_str(), std::ios::in | std::ios::binary);
+    if (!resumeFile.is_open()) {
+      // Starting again would truncate the samples of the earlier run, so a
+      // mistyped or lost checkpoint must not pass silently
+      if (outputFile.isNotNull()) {
+        std::string outputPath = as<std::string>(outputFile.get());
+        std::ifstream existing(
+          outputPath.c_str(), std::ios::in | std::ios::binary | std::ios::ate
+        );
+        if (existing.is_open() && existing.tellg() > 0) {
+          stop(
+            "Checkpoint %s not found; not overwriting the samples in %s",
+            path, outputPath
+          );
+        }
+      }
+      Rcpp::warning("Checkpoint %s not found; starting from the beginning", path);
+    }
+  }
+  if (resumeFile.is_open()) {
+    std::string path = as<std::string>(checkpointFile.get());
+    char magic[sizeof(CHECKPOINT_MAGIC)];
+    resumeFile.read(magic, sizeof(magic));
+    if (
+      !resumeFile
+      || std::string(magic, sizeof(magic)) != std::string(CHECKPOINT_MAGIC, sizeof(magic))
+      || readBinary<int32_t>(resumeFile) != CHECKPOINT_VERSION
+    ) {
+      stop("%s is not an armspp checkpoint", path);
+    }
+    if (
+      readBinary<int32_t>(resumeFile) != nChains
+      || readBinary<int32_t>(resumeFile) != nDimensions
+    ) {
+      stop("Checkpoint does not match the number of chains and coordinates");
+    }
+    // Resuming with other settings would stitch together a chain thinned or
+    // burnt in differently before and after the checkpoint
+    if (
+      readBinary<int32_t>(resumeFile) != burnIn
+      || readBinary<int32_t>(resumeFile) != thin
+      || readBinary<int32_t>(resumeFile) != chunkSize
+    ) {
+      stop("Checkpoint was written with a different burn_in, thin or chunk_size");
+    }
+    nBurnInDone = readBinary<int32_t>(resumeFile);
+    nSamplesDone = readBinary<int32_t>(resumeFile);
+    if (nBurnInDone > burnIn || nSamplesDone > nSamples) {
+      stop("Checkpoint is from a longer run");
+    }
+  }
+  int nBurnInRemaining = burnIn - nBurnInDone;
+  int nSamplesRemaining = nSamples - nSamplesDone;
 
-      ARMS<double, decltype(logPdfLambda), NumericVector::iterator> dist(
-        logPdfLambda,
-        lower[p % lower.size()],
-        upper[p % upper.size()],
-        convex[p % convex.size()],
-        initialVector.begin(), initialVector.size(),
-        maxPoints[p % maxPoints.size()],
-        metropolis[p % metropolis.size()],
-        current[p % previous.size()]
-      );
+  // Without a sink, all samples are kept in memory and returned; with one,
+  // only the current chunk is. The run is only split into chunks if needed
+  bool isStreaming = callback.isNotNull() || outputFile.isNotNull();
+  bool isCheckpointing = checkpointFile.isNotNull();
+  if (!isStreaming && !isCheckpointing) {
+    chunkSize = std::max(nSamplesRemaining, 1);
+  }
+  int nBurnInChunk = burnInChunk(
+    nBurnInRemaining, thin, chunkSize, isStreaming || isCheckpointing
+  );
+  int bufferLength = isStreaming
+    ? std::min(chunkSize, nSamplesRemaining)
+    : nSamplesRemaining;
+
+  // A resumed run overwrites the output file from the end of the samples in
+  // the checkpoint, in case more were written before the run was interrupted
+  std::fstream file;
+  if (outputFile.isNotNull()) {
+    std::string path = as<std::string>(outputFile.get());
+    if (resumeFile.is_open()) {
+      file.open(path.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+      if (file) {
+        file.seekp(
+          static_cast<std::streamoff>(nSamplesDone) * nChains * nDimensions
+            * sizeof(double)
+        );
+      }
+    } else {
+      file.open(path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    }
+    if (!file) {
+      stop("Could not open %s for writing", path);
+    }
+  }
+
+  RObject names = R_NilValue;
+  if (!Rf_isNull(previous.attr("dimnames"))) {
+    names = as<List>(previous.attr("dimnames"))[1];
+  }
+
+  // Samples are stored by iteration, then chain, then coordinate. A single
+  // chain uses the global generator; otherwise each chain has its own stream.
+  // With blocks, each coordinate then has a stream split from its chain's, so
+  // the output does not depend on the number of threads
+  NumericVector samples(
+    static_cast<long>(bufferLength) * nChains * nDimensions
+  );
+  double* buffer = samples.begin();
+  uint_fast64_t seed = nChains > 1 ? rng() : 0;
+
+  // Threads go to the chains if there are several, and otherwise to the
+  // coordinates within each block
+  int nThreadsPerChain = nChains > 1 || !isBlocked ? 1 : nThreads;
 
-      current[p] = dist(rng);
+  // Progress is counted in sweeps over all chains, from whichever thread runs
+  // them, and only shown from this one
+  ProgressBar pb(
+    (static_cast<uint64_t>(nSamplesRemaining) * thin + nBurnInRemaining)
+      * nChains
+  );
+  auto showSweeps = [&]() {
+    if (showProgress) pb.update();
+  };
+  auto progress = [&]() {
+    if (showProgress) ++pb;
+  };
 
-      samples(i, p) = current[p];
+  // Passes each finished chunk to the sinks. The file holds the samples in
+  // row-major order: every coordinate of the first chain for the first
+  // iteration, then the second chain, and so on
+  std::vector<double> row(static_cast<long>(nChains) * nDimensions);
+  long chunkStride = static_cast<long>(bufferLength) * nChains;
+  auto flush = [&](int first, int n, const double* chunk) {
+    if (file.is_open()) {
+      for (int i = 0; i < n; ++i) {
+        for (int chain = 0; chain < nChains; ++chain) {
+          for (int p = 0; p < nDimensions; ++p) {
+            row[static_cast<long>(chain) * nDimensions + p] = chunk[
+              i + static_cast<long>(bufferLength) * chain + p * chunkStride
+            ];
+          }
+        }
+        file.write(
+          reinterpret_cast<const char*>(row.data()),
+          row.size() * sizeof(double)
+        );
+      }
+      file.flush();
+      if (!file) {
+        stop("Failed to write samples to output_file");
+      }
+    }
+    if (callback.isNotNull()) {
+      NumericVector output(static_cast<long>(n) * nChains * nDimensions);
+      for (int p = 0; p < nDimensions; ++p) {
+        for (int chain = 0; chain < nChains; ++chain) {
+          const double* source = (
+            chunk + static_cast<long>(bufferLength) * chain + p * chunkStride
+          );
+          std::copy(
+            source,
+            source + n,
+            output.begin() + static_cast<long>(n) * (chain + nChains * p)
+          );
+        }
+      }
+      setSampleDimensions(output, n, nChains, nDimensions, names);
+      Function(callback.get())(output, nSamplesDone + first);
     }
+  };
 
-    if (showProgress) {
-      ++pb;
+  int nEvaluations = 0;
+  std::vector<Diagnostics> diagnostics(nDimensions);
+  // Sums the counts for each coordinate over the chains
+  auto addDiagnostics = [&](const std::vector<Diagnostics>& chainDiagnostics) {
+    for (int p = 0; p < nDimensions; ++p) {
+      diagnostics[p] += chainDiagnostics[p];
+    }
+  };
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  if (isNative && hasNativeGradient(logPdf)) {
+    std::vector<GibbsChain<NativeGibbsLogPdfWithGradientWrapper> > chains =
+      makeNativeChains<NativeGibbsLogPdfWithGradientWrapper>(
+        asNativeGibbsLogPdfWithGradient(logPdf),
+        previous, nThreadsPerChain, rng, seed, settings
+      );
+    runGibbs(
+      chains, nChains > 1 ? nThreads : 1, resumeFile, checkpointFile,
+      nBurnInDone, nBurnInRemaining, nSamplesDone, nSamplesRemaining, thin,
+      chunkSize, nBurnInChunk, buffer, bufferLength, progress, showSweeps,
+      flush
+    );
+    for (int chain = 0; chain < nChains; ++chain) {
+      nEvaluations += chains[chain].nEvaluations();
+      addDiagnostics(chains[chain].diagnostics());
+    }
+  } else if (isNative) {
+    std::vector<GibbsChain<NativeGibbsLogPdfWrapper> > chains =
+      makeNativeChains<NativeGibbsLogPdfWrapper>(
+        asNativeGibbsLogPdf(logPdf),
+        previous, nThreadsPerChain, rng, seed, settings
+      );
+    runGibbs(
+      chains, nChains > 1 ? nThreads : 1, resumeFile, checkpointFile,
+      nBurnInDone, nBurnInRemaining, nSamplesDone, nSamplesRemaining, thin,
+      chunkSize, nBurnInChunk, buffer, bufferLength, progress, showSweeps,
+      flush
+    );
+    for (int chain = 0; chain < nChains; ++chain) {
+      nEvaluations += chains[chain].nEvaluations();
+      addDiagnostics(chains[chain].diagnostics());
+    }
+  } else {
+    Function logPdfFunction = as<Function>(logPdf);
+    std::vector<GibbsChain<GibbsFunctionWrapper> > chains;
+    chains.reserve(nChains);
+    for (int chain = 0; chain < nChains; ++chain) {
+      chains.push_back(GibbsChain<GibbsFunctionWrapper>(
+        std::vector<GibbsFunctionWrapper>(1, GibbsFunctionWrapper(
+          logPdfFunction,
+          previous(chain, _)
+        )),
+        nChains > 1 ? streamGenerator(seed, chain) : rng,
+        nDimensions, settings
+      ));
+    }
+    runGibbs(
+      chains, 1, resumeFile, checkpointFile,
+      nBurnInDone, nBurnInRemaining, nSamplesDone, nSamplesRemaining, thin,
+      chunkSize, nBurnInChunk, buffer, bufferLength, progress, showSweeps,
+      flush
+    );
+    for (int chain = 0; chain < nChains; ++chain) {
+      nEvaluations += chains[chain].nEvaluations();
+      addDiagnostics(chains[chain].diagnostics());
     }
   }
-  Nullable<CharacterVector> names = previous.names();
-  colnames(samples) = names;
 
-  if (includeNEvaluations) {
-    List output;
-    output["n_evaluations"] = nEvaluations;
-    output["samples"] = samples;
-    return output;
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+  // The last sweeps may have been counted by other threads
+  showSweeps();
+
+  RObject output = R_NilValue;
+  if (!isStreaming) {
+    setSampleDimensions(
+      samples, nSamplesRemaining, nChains, nDimensions, names
+    );
+    output = samples;
+  }
+
+  if (includeNEvaluations || includeDiagnostics) {
+    List outputList;
+    if (includeNEvaluations) {
+      outputList["n_evaluations"] = nEvaluations;
+    }
+    if (includeDiagnostics) {
+      List diagnosticsList = diagnosticsToList(diagnostics);
+      if (!isStreaming) {
+        // Summed over the chains, and per second of the whole run
+        NumericVector ess(nDimensions, 0.);
+        NumericVector essPerSecond(nDimensions);
+        for (int p = 0; p < nDimensions; ++p) {
+          for (int chain = 0; chain < nChains; ++chain) {
+            ess[p] += effectiveSampleSize(
+              buffer + static_cast<long>(bufferLength) * (chain + p * nChains),
+              nSamplesRemaining,
+              1
+            );
+          }
+          essPerSecond[p] = ess[p] / elapsed.count();
+        }
+        diagnosticsList["effective_sample_size"] = ess;
+        diagnosticsList["effective_samples_per_second"] = essPerSecond;
+      }
+      outputList["diagnostics"] = diagnosticsList;
+    }
+    if (!isStreaming) {
+      outputList["samples"] = output;
+    }
+    return outputList;
   } else {
-    return samples;
+    return output;
   }
 }
@@ -1,30 +1,63 @@
 #include <Rcpp.h>
-#include <random>
+#include <cstdint>
+#include <vector>
 #include <armspp>
+#include <armspp_native>
 
+#include "parallel.h"
 #include "utils.h"
 
 using namespace Rcpp;
 using armspp::ARMS;
+using armspp::AdaptiveRejection;
+using armspp::AdaptiveRejectionMetropolis;
+using armspp::Diagnostics;
+using armspp::FrozenEnvelope;
+using armspp::NativeLogPdf;
+using armspp::NativeLogPdfWithGradient;
+using armspp::NativeLogPdfWithGradientWrapper;
+using armspp::NativeLogPdfWrapper;
+using armspp::NoPruning;
+using armspp::Pruning;
+using armspp::RuntimeMetropolis;
+using armspp::asNativeLogPdf;
+using armspp::asNativeLogPdfWithGradient;
+using armspp::bracketInitialPoints;
+using armspp::diagnosticsToList;
+using armspp::envelopeToList;
+using armspp::hasNativeGradient;
+using armspp::isNativeLogPdf;
 using armspp::listToDottedPair;
+using armspp::listToEnvelope;
+using armspp::StandardMath;
+using armspp::Status;
+using armspp::Xoshiro256PlusPlus;
+using armspp::parallelFor;
+using armspp::statusMessage;
+using armspp::streamGenerator;
+
+// Builds the call f(x, ...), with x a placeholder that FunctionWrapper
+// overwrites on each evaluation
+Language makeLogPdfCall(Function f, DottedPair arguments) {
+  return Rcpp_lcons(f, grow(NumericVector(1), arguments));
+}
 
 class FunctionWrapper {
 public:
-  FunctionWrapper(Function f, DottedPair arguments)
-    : f_(f),
-      arguments_(arguments),
+  explicit FunctionWrapper(Language call)
+    : call_(call),
       nEvaluations_(0) {}
 
   double operator()(double x) {
-    NumericVector output;
-    if (arguments_ == R_NilValue) {
-      output = f_(x);
-    } else {
-      output = Rcpp_eval(Rcpp_lcons(
-        f_,
-        grow(x, arguments_)
-      ));
+    // Reuse the argument vector unless the log density kept a reference to it
+    // last time it was called, in which case it must not be modified
+    SEXP xValue = CADR(call_);
+    if (MAYBE_SHARED(xValue)) {
+      xValue = Rf_allocVector(REALSXP, 1);
+      SETCADR(call_, xValue);
     }
+    REAL(xValue)[0] = x;
+    NumericVector output = Rcpp_eval(call_);
     ++nEvaluations_;
     return output[0];
   }
@@ -32,11 +65,402 @@ public:
   int nEvaluations() const { return nEvaluations_; }
 
 private:
-  Function f_;
-  DottedPair arguments_;
+  Language call_;
   int nEvaluations_;
 };
 
+// Evaluates a vectorised R log density, which is given a vector of points and
+// returns the log density at each
+class VectorisedFunctionWrapper {
+public:
+  explicit VectorisedFunctionWrapper(Language call)
+    : call_(call),
+      nEvaluations_(0) {}
+
+  double operator()(double x) {
+    double y;
+    evaluate(&x, &y, 1);
+    return y;
+  }
+
+  void evaluate(const double* x, double* y, int n) {
+    // As in FunctionWrapper, the argument vector is reused where possible
+    SEXP xValue = CADR(call_);
+    if (MAYBE_SHARED(xValue) || Rf_xlength(xValue) != n) {
+      xValue = Rf_allocVector(REALSXP, n);
+      SETCADR(call_, xValue);
+    }
+    std::copy(x, x + n, REAL(xValue));
+    NumericVector output = Rcpp_eval(call_);
+    if (output.size() != n) {
+      stop("A vectorised log_pdf must return one value per point");
+    }
+    std::copy(output.begin(), output.end(), y);
+    nEvaluations_ += n;
+  }
+
+  int nEvaluations() const { return nEvaluations_; }
+
+private:
+  Language call_;
+  int nEvaluations_;
+};
+
+// Maximum number of points at which a vectorised log density is evaluated at
+// once
+const int VECTORISED_BATCH_SIZE = 1024;
+
+// Fills samples by adapting dist; vectorised log densities are evaluated in
+// batches
+template<
+  typename Functor,
+  typename Iterator,
+  typename Variant,
+  typename PruningPolicy
+>
+void sampleAdaptive(
+  ARMS<
+    double, Functor, Iterator, StandardMath, Variant, Diagnostics,
+    PruningPolicy
+  >& dist,
+  Xoshiro256PlusPlus& rng,
+  NumericVector samples
+) {
+  Status status = dist.trySample(rng, samples.begin(), samples.end());
+  if (status != Status::SUCCESS) {
+    stop(statusMessage(status));
+  }
+}
+
+template<typename Iterator, typename Variant, typename PruningPolicy>
+void sampleAdaptive(
+  ARMS<
+    double, VectorisedFunctionWrapper, Iterator, StandardMath, Variant,
+    Diagnostics, PruningPolicy
+  >& dist,
+  Xoshiro256PlusPlus& rng,
+  NumericVector samples
+) {
+  dist.sampleVectorised(
+    rng, samples.begin(), samples.end(), VECTORISED_BATCH_SIZE
+  );
+}
+
+// Fills samples using a saved envelope without adapting it
+template<typename Functor>
+void sampleFrozen(
+  const FrozenEnvelope<double>& frozen,
+  Functor& f,
+  Xoshiro256PlusPlus& rng,
+  bool metropolis,
+  double previous,
+  NumericVector samples
+) {
+  if (metropolis) {
+    double xPrevious = previous;
+    double yPrevious = f(xPrevious);
+    for (int i = 0; i < samples.size(); ++i) {
+      samples[i] = frozen.metropolisStep(rng, f, xPrevious, yPrevious);
+    }
+  } else {
+    for (int i = 0; i < samples.size(); ++i) {
+      samples[i] = frozen(rng, f);
+    }
+  }
+}
+
+void sampleFrozen(
+  const FrozenEnvelope<double>& frozen,
+  VectorisedFunctionWrapper& f,
+  Xoshiro256PlusPlus& rng,
+  bool metropolis,
+  double previous,
+  NumericVector samples
+) {
+  double xPrevious = previous;
+  frozen.sampleVectorised(
+    rng, f, metropolis, xPrevious,
+    samples.begin(), samples.end(),
+    VECTORISED_BATCH_SIZE
+  );
+}
+
+// Copies each set of initial points out of the R list
+std::vector<std::vector<double> > initialPoints(List initial) {
+  std::vector<std::vector<double> > output;
+  output.reserve(initial.size());
+  for (int i = 0; i < initial.size(); ++i) {
+    NumericVector initialVector = initial[i];
+    output.push_back(std::vector<double>(
+      initialVector.begin(), initialVector.end()
+    ));
+  }
+  return output;
+}
+
+int gcd(int a, int b) {
+  while (b != 0) {
+    int remainder = a % b;
+    a = b;
+    b = remainder;
+  }
+  return a;
+}
+
+// The least common multiple of period and size, the length of a recycled
+// parameter, capped at nSamples
+int extendPeriod(int period, int size, int nSamples) {
+  if (size == 0) return period;
+  int64_t multiple = static_cast<int64_t>(period / gcd(period, size)) * size;
+  return static_cast<int>(std::min<int64_t>(std::max(nSamples, 1), multiple));
+}
+
+// Constructs an envelope for f and samples from it, with Metropolis steps
+// chosen at compile time by Variant, which must agree with metropolis, and
+// what happens once the envelope is full by PruningPolicy. If
+// autoInitial, as many initial points as initial has are chosen around the
+// mode, starting from previous. The counts of the sampler are added to
+// diagnostics
+template<typename Variant, typename PruningPolicy, typename Functor>
+void sampleNewEnvelope(
+  Functor& f,
+  Xoshiro256PlusPlus& rng,
+  double lower,
+  double upper,
+  NumericVector initial,
+  double convex,
+  int maxPoints,
+  bool metropolis,
+  double previous,
+  bool autoInitial,
+  bool includeEnvelope,
+  NumericVector samples,
+  List& outputEnvelope,
+  Diagnostics& diagnostics
+) {
+  if (autoInitial) {
+    std::vector<double> x, y, gradient;
+    bracketInitialPoints(
+      f, lower, upper, previous, initial.size(), x, y, gradient
+    );
+    ARMS<
+      double, Functor, std::vector<double>::iterator, StandardMath, Variant,
+      Diagnostics, PruningPolicy
+    > dist(
+      f,
+      lower, upper, convex,
+      x.begin(), y.begin(), gradient.begin(), x.size(),
+      maxPoints, metropolis, previous
+    );
+
+    sampleAdaptive(dist, rng, samples);
+    diagnostics += dist.diagnostics();
+    if (includeEnvelope) {
+      outputEnvelope = envelopeToList(dist.freeze());
+    }
+    return;
+  }
+
+  // ARMS only reads the initial points, so they need not be copied
+  ARMS<
+    double, Functor, NumericVector::iterator, StandardMath, Variant,
+    Diagnostics, PruningPolicy
+  > dist(
+    f,
+    lower, upper, convex,
+    initial.begin(), initial.size(),
+    maxPoints, metropolis, previous
+  );
+
+  sampleAdaptive(dist, rng, samples);
+  diagnostics += dist.diagnostics();
+  if (includeEnvelope) {
+    outputEnvelope = envelopeToList(dist.freeze());
+  }
+}
+
+// Draws a single sample from a new envelope for f, for when each sample comes
+// from its own distribution, adding the counts of the sampler to diagnostics.
+// initial is used as in sampleNewEnvelope
+template<typename Functor>
+Status sampleOnce(
+  Functor& f,
+  Xoshiro256PlusPlus& rng,
+  double lower,
+  double upper,
+  const std::vector<double>& initial,
+  double convex,
+  int maxPoints,
+  bool metropolis,
+  double previous,
+  bool autoInitial,
+  double& output,
+  Diagnostics& diagnostics
+) {
+  typedef ARMS<
+    double, Functor, std::vector<double>::const_iterator, StandardMath,
+    RuntimeMetropolis, Diagnostics
+  > Sampler;
+
+  Status status;
+  if (autoInitial) {
+    std::vector<double> x, y, gradient;
+    bracketInitialPoints(
+      f, lower, upper, previous, initial.size(), x, y, gradient
+    );
+    Sampler dist(
+      f,
+      lower, upper, convex,
+      x.cbegin(), y.cbegin(), gradient.cbegin(), x.size(),
+      maxPoints, metropolis, previous
+    );
+    status = dist.trySample(rng, output);
+    diagnostics += dist.diagnostics();
+  } else {
+    Sampler dist(
+      f,
+      lower, upper, convex,
+      initial.begin(), initial.size(),
+      maxPoints, metropolis, previous
+    );
+    status = dist.trySample(rng, output);
+    diagnostics += dist.diagnostics();
+  }
+  return status;
+}
+
+// Fills samples from a single envelope for f, as sampleNewEnvelope does, but
+// without the R API, so that distributions can be split between threads.
+// Variant and PruningPolicy are as for sampleNewEnvelope
+template<typename Variant, typename PruningPolicy, typename Functor>
+Status sampleDistribution(
+  Functor& f,
+  Xoshiro256PlusPlus& rng,
+  double lower,
+  double upper,
+  const std::vector<double>& initial,
+  double convex,
+  int maxPoints,
+  bool metropolis,
+  double previous,
+  bool autoInitial,
+  std::vector<double>& samples,
+  Diagnostics& diagnostics
+) {
+  typedef ARMS<
+    double, Functor, std::vector<double>::const_iterator, StandardMath,
+    Variant, Diagnostics, PruningPolicy
+  > Sampler;
+
+  Status status;
+  if (autoInitial) {
+    std::vector<double> x, y, gradient;
+    bracketInitialPoints(
+      f, lower, upper, previous, initial.size(), x, y, gradient
+    );
+    Sampler dist(
+      f,
+      lower, upper, convex,
+      x.cbegin(), y.cbegin(), gradient.cbegin(), x.size(),
+      maxPoints, metropolis, previous
+    );
+    status = dist.trySample(rng, samples.begin(), samples.end());
+    diagnostics += dist.diagnostics();
+  } else {
+    Sampler dist(
+      f,
+      lower, upper, convex,
+      initial.begin(), initial.size(),
+      maxPoints, metropolis, previous
+    );
+    status = dist.trySample(rng, samples.begin(), samples.end());
+    diagnostics += dist.diagnostics();
+  }
+  return status;
+}
+
+// As above, choosing Variant and PruningPolicy as sampleSingleDistribution does
+template<typename Functor>
+Status sampleDistribution(
+  Functor& f,
+  Xoshiro256PlusPlus& rng,
+  double lower,
+  double upper,
+  const std::vector<double>& initial,
+  double convex,
+  int maxPoints,
+  bool metropolis,
+  double previous,
+  bool autoInitial,
+  bool prune,
+  std::vector<double>& samples,
+  Diagnostics& diagnostics
+) {
+  if (metropolis) {
+    return sampleDistribution<AdaptiveRejectionMetropolis, NoPruning>(
+      f, rng, lower, upper, initial, convex, maxPoints, metropolis, previous,
+      autoInitial, samples, diagnostics
+    );
+  } else if (prune) {
+    return sampleDistribution<AdaptiveRejection, Pruning>(
+      f, rng, lower, upper, initial, convex, maxPoints, metropolis, previous,
+      autoInitial, samples, diagnostics
+    );
+  }
+  return sampleDistribution<AdaptiveRejection, NoPruning>(
+    f, rng, lower, upper, initial, convex, maxPoints, metropolis, previous,
+    autoInitial, samples, diagnostics
+  );
+}
+
+// Samples from a single distribution, using the saved envelope if one is
+// given and otherwise constructing a new one. Most samples are drawn here, so
+// the sampler is specialised for the choice of metropolis and of prune, which
+// only applies without Metropolis steps
+template<typename Functor>
+void sampleSingleDistribution(
+  Functor& f,
+  Xoshiro256PlusPlus& rng,
+  double lower,
+  double upper,
+  NumericVector initial,
+  double convex,
+  int maxPoints,
+  bool metropolis,
+  double previous,
+  bool autoInitial,
+  bool prune,
+  Nullable<List> envelope,
+  bool includeEnvelope,
+  NumericVector samples,
+  List& outputEnvelope,
+  Diagnostics& diagnostics
+) {
+  if (envelope.isNotNull()) {
+    FrozenEnvelope<double> frozen = listToEnvelope(envelope.get());
+    sampleFrozen(frozen, f, rng, metropolis, previous, samples);
+    outputEnvelope = envelope.get();
+    return;
+  }
+
+  if (metropolis) {
+    sampleNewEnvelope<AdaptiveRejectionMetropolis, NoPruning>(
+      f, rng, lower, upper, initial, convex, maxPoints, metropolis, previous,
+      autoInitial, includeEnvelope, samples, outputEnvelope, diagnostics
+    );
+  } else if (prune) {
+    sampleNewEnvelope<AdaptiveRejection, Pruning>(
+      f, rng, lower, upper, initial, convex, maxPoints, metropolis, previous,
+      autoInitial, includeEnvelope, samples, outputEnvelope, diagnostics
+    );
+  } else {
+    sampleNewEnvelope<AdaptiveRejection, NoPruning>(
+      f, rng, lower, upper, initial, convex, maxPoints, metropolis, previous,
+      autoInitial, includeEnvelope, samples, outputEnvelope, diagnostics
+    );
+  }
+}
+
 // [[Rcpp::export(name = '.arms')]]
 RObject arms(
   int nSamples,
@@ -49,24 +473,58 @@ RObject arms(
   IntegerVector metropolis,
   NumericVector previous,
   List arguments,
-  bool includeNEvaluations
+  bool includeNEvaluations,
+  bool includeDiagnostics,
+  Nullable<List> envelope,
+  bool includeEnvelope,
+  int nThreads,
+  bool vectorised,
+  bool autoInitial,
+  bool prune
 ) {
-  std::mt19937_64 rng(static_cast<uint_fast64_t>(UINT_FAST64_MAX * R::unif_rand()));
+  Xoshiro256PlusPlus rng(static_cast<uint_fast64_t>(UINT_FAST64_MAX * R::unif_rand()));
 
+  // The arguments repeat with a period of the least common multiple of their
+  // lengths (and that of logPdf), so only that many distinct calls are needed
   int maxArgumentsSize = 1;
+  int period = std::max(1, std::min(
+    nSamples,
+    static_cast<int>(logPdf.size())
+  ));
   for (int i = 0; i < arguments.size(); ++i){
     if (::Rf_isVector(arguments[i]) && !Rf_isMatrix(arguments[i])) {
-      maxArgumentsSize = std::max(maxArgumentsSize, static_cast<int>(
-        static_cast<GenericVector>(
-          arguments[i]
-        ).size()
-      ));
+      int size = static_cast<GenericVector>(arguments[i]).size();
+      maxArgumentsSize = std::max(maxArgumentsSize, size);
+      period = extendPeriod(period, size, nSamples);
     }
   }
 
+  int nNative = 0;
+  for (int i = 0; i < logPdf.size(); ++i) {
+    if (isNativeLogPdf(logPdf[i])) ++nNative;
+  }
+  bool isNative = nNative > 0;
+  if (isNative && nNative != logPdf.size()) {
+    stop("Native and R log densities cannot be mixed");
+  }
+  if (isNative && arguments.size() > 0) {
+    stop("arguments cannot be passed to a native log density");
+  }
+  if (nThreads < 1) {
+    stop("n_threads must be at least 1");
+  }
+  if (nThreads > 1 && !isNative) {
+    stop("Multiple threads can only be used with a native log density");
+  }
+  if (vectorised && isNative) {
+    stop("Native log densities cannot be vectorised");
+  }
+
   int nEvaluations = 0;
+  Diagnostics diagnostics;
   NumericVector samples(nSamples);
-  if (
+  List outputEnvelope;
+  bool isSingleDistribution = (
     initial.size() == 1
     && lower.size() == 1
     && upper.size() == 1
@@ -76,50 +534,274 @@ RObject arms(
     && metropolis.size() == 1
     && previous.size() == 1
     && maxArgumentsSize == 1
-  ) {
-    // Special case: only one distribution to sample from
-    NumericVector initialVector(clone(as<NumericVector>(initial[0])));
+  );
+  if (envelope.isNotNull() && !isSingleDistribution) {
+    stop("A saved envelope can only be used with a single distribution");
+  }
+  if (includeEnvelope && !isSingleDistribution) {
+    stop("An envelope can only be returned for a single distribution");
+  }
+  if (vectorised && !isSingleDistribution) {
+    stop("A vectorised log density can only be used with a single distribution");
+  }
+  if (includeDiagnostics && envelope.isNotNull()) {
+    stop("Diagnostics are not available when sampling from a saved envelope");
+  }
 
-    FunctionWrapper f(logPdf[0], listToDottedPair(arguments, 0));
-    ARMS<double, FunctionWrapper, NumericVector::iterator> dist(
-      f,
-      lower[0], upper[0], convex[0],
-      initialVector.begin(), initialVector.size(),
-      maxPoints[0], metropolis[0], previous[0]
-    );
+  // The distributions themselves repeat with the period of all the
+  // parameters. If that is shorter than nSamples, one envelope is built for
+  // each distinct distribution and all its samples are drawn from it, as for a
+  // single distribution, then put back in order
+  int nDistributions = period;
+  nDistributions = extendPeriod(nDistributions, lower.size(), nSamples);
+  nDistributions = extendPeriod(nDistributions, upper.size(), nSamples);
+  nDistributions = extendPeriod(nDistributions, initial.size(), nSamples);
+  nDistributions = extendPeriod(nDistributions, convex.size(), nSamples);
+  nDistributions = extendPeriod(nDistributions, maxPoints.size(), nSamples);
+  nDistributions = extendPeriod(nDistributions, metropolis.size(), nSamples);
+  nDistributions = extendPeriod(nDistributions, previous.size(), nSamples);
+
+  if (isSingleDistribution) {
+    // Special case: only one distribution to sample from
+    if (isNative && hasNativeGradient(logPdf[0])) {
+      NativeLogPdfWithGradientWrapper f(asNativeLogPdfWithGradient(logPdf[0]));
+      sampleSingleDistribution(
+        f, rng,
+        lower[0], upper[0], initial[0], convex[0],
+        maxPoints[0], metropolis[0], previous[0], autoInitial, prune,
+        envelope, includeEnvelope, samples, outputEnvelope, diagnostics
+      );
+      nEvaluations += f.nEvaluations();
+    } else if (isNative) {
+      NativeLogPdfWrapper f(asNativeLogPdf(logPdf[0]));
+      sampleSingleDistribution(
+        f, rng,
+        lower[0], upper[0], initial[0], convex[0],
+        maxPoints[0], metropolis[0], previous[0], autoInitial, prune,
+        envelope, includeEnvelope, samples, outputEnvelope, diagnostics
+      );
+      nEvaluations += f.nEvaluations();
+    } else if (vectorised) {
+      VectorisedFunctionWrapper f(makeLogPdfCall(
+        logPdf[0],
+        listToDottedPair(arguments, 0)
+      ));
+      sampleSingleDistribution(
+        f, rng,
+        lower[0], upper[0], initial[0], convex[0],
+        maxPoints[0], metropolis[0], previous[0], autoInitial, prune,
+        envelope, includeEnvelope, samples, outputEnvelope, diagnostics
+      );
+      nEvaluations += f.nEvaluations();
+    } else {
+      FunctionWrapper f(makeLogPdfCall(
+        logPdf[0],
+        listToDottedPair(arguments, 0)
+      ));
+      sampleSingleDistribution(
+        f, rng,
+        lower[0], upper[0], initial[0], convex[0],
+        maxPoints[0], metropolis[0], previous[0], autoInitial, prune,
+        envelope, includeEnvelope, samples, outputEnvelope, diagnostics
+      );
+      nEvaluations += f.nEvaluations();
+    }
+  } else if (isNative) {
+    // Nothing below touches the R API, so the samples, or the distinct
+    // distributions if they repeat, can be split between threads, each with
+    // its own stream of random numbers. Densities with and without gradients
+    // can be mixed, so each has a slot in both vectors
+    std::vector<NativeLogPdf> nativeLogPdfs(logPdf.size());
+    std::vector<NativeLogPdfWithGradient> gradientLogPdfs(logPdf.size());
+    std::vector<bool> hasGradient(logPdf.size());
+    for (int i = 0; i < logPdf.size(); ++i) {
+      hasGradient[i] = hasNativeGradient(logPdf[i]);
+      if (hasGradient[i]) {
+        gradientLogPdfs[i] = asNativeLogPdfWithGradient(logPdf[i]);
+      } else {
+        nativeLogPdfs[i] = asNativeLogPdf(logPdf[i]);
+      }
+    }
+    std::vector<std::vector<double> > initialValues = initialPoints(initial);
+    std::vector<double> lowerValues(lower.begin(), lower.end());
+    std::vector<double> upperValues(upper.begin(), upper.end());
+    std::vector<double> convexValues(convex.begin(), convex.end());
+    std::vector<int> maxPointsValues(maxPoints.begin(), maxPoints.end());
+    std::vector<int> metropolisValues(metropolis.begin(), metropolis.end());
+    std::vector<double> previousValues(previous.begin(), previous.end());
 
-    for (int i = 0; i < nSamples; ++i) {
-      samples[i] = dist(rng);
+    uint_fast64_t seed = rng();
+    double* output = samples.begin();
+    std::vector<int> nEvaluationsPerThread(nThreads, 0);
+    std::vector<Status> statusPerThread(nThreads, Status::SUCCESS);
+    std::vector<Diagnostics> diagnosticsPerThread(nThreads);
+    if (nDistributions < nSamples) {
+      parallelFor(nDistributions, nThreads, [&](int thread, int begin, int end) {
+        Xoshiro256PlusPlus threadRng = streamGenerator(seed, thread);
+        std::vector<double> distributionSamples;
+        for (int k = begin; k < end && statusPerThread[thread] == Status::SUCCESS; ++k) {
+          distributionSamples.resize(
+            (nSamples - k + nDistributions - 1) / nDistributions
+          );
+          int l = k % nativeLogPdfs.size();
+          if (hasGradient[l]) {
+            NativeLogPdfWithGradientWrapper f(gradientLogPdfs[l]);
+            statusPerThread[thread] = sampleDistribution(
+              f, threadRng,
+              lowerValues[k % lowerValues.size()],
+              upperValues[k % upperValues.size()],
+              initialValues[k % initialValues.size()],
+              convexValues[k % convexValues.size()],
+              maxPointsValues[k % maxPointsValues.size()],
+              metropolisValues[k % metropolisValues.size()],
+              previousValues[k % previousValues.size()],
+              autoInitial, prune, distributionSamples,
+              diagnosticsPerThread[thread]
+            );
+            nEvaluationsPerThread[thread] += f.nEvaluations();
+          } else {
+            NativeLogPdfWrapper f(nativeLogPdfs[l]);
+            statusPerThread[thread] = sampleDistribution(
+              f, threadRng,
+              lowerValues[k % lowerValues.size()],
+              upperValues[k % upperValues.size()],
+              initialValues[k % initialValues.size()],
+              convexValues[k % convexValues.size()],
+              maxPointsValues[k % maxPointsValues.size()],
+              metropolisValues[k % metropolisValues.size()],
+              previousValues[k % previousValues.size()],
+              autoInitial, prune, distributionSamples,
+              diagnosticsPerThread[thread]
+            );
+            nEvaluationsPerThread[thread] += f.nEvaluations();
+          }
+          for (std::size_t j = 0; j < distributionSamples.size(); ++j) {
+            output[k + j * nDistributions] = distributionSamples[j];
+          }
+        }
+      });
+    } else {
+      parallelFor(nSamples, nThreads, [&](int thread, int begin, int end) {
+        Xoshiro256PlusPlus threadRng = streamGenerator(seed, thread);
+        for (int i = begin; i < end && statusPerThread[thread] == Status::SUCCESS; ++i) {
+          int k = i % nativeLogPdfs.size();
+          if (hasGradient[k]) {
+            NativeLogPdfWithGradientWrapper f(gradientLogPdfs[k]);
+            statusPerThread[thread] = sampleOnce(
+              f, threadRng,
+              lowerValues[i % lowerValues.size()],
+              upperValues[i % upperValues.size()],
+              initialValues[i % initialValues.size()],
+              convexValues[i % convexValues.size()],
+              maxPointsValues[i % maxPointsValues.size()],
+              metropolisValues[i % metropolisValues.size()],
+              previousValues[i % previousValues.size()],
+              autoInitial, output[i], diagnosticsPerThread[thread]
+            );
+            nEvaluationsPerThread[thread] += f.nEvaluations();
+          } else {
+            NativeLogPdfWrapper f(nativeLogPdfs[k]);
+            statusPerThread[thread] = sampleOnce(
+              f, threadRng,
+              lowerValues[i % lowerValues.size()],
+              upperValues[i % upperValues.size()],
+              initialValues[i % initialValues.size()],
+              convexValues[i % convexValues.size()],
+              maxPointsValues[i % maxPointsValues.size()],
+              metropolisValues[i % metropolisValues.size()],
+              previousValues[i % previousValues.size()],
+              autoInitial, output[i], diagnosticsPerThread[thread]
+            );
+            nEvaluationsPerThread[thread] += f.nEvaluations();
+          }
+        }
+      });
+    }
+    for (int thread = 0; thread < nThreads; ++thread) {
+      if (statusPerThread[thread] != Status::SUCCESS) {
+        stop(statusMessage(statusPerThread[thread]));
+      }
+      nEvaluations += nEvaluationsPerThread[thread];
+      diagnostics += diagnosticsPerThread[thread];
     }
-    nEvaluations += f.nEvaluations();
   } else {
-    for (int i = 0; i < nSamples; ++i) {
-      NumericVector initialVector(clone(as<NumericVector>(initial[i % initial.size()])));
-
-      FunctionWrapper f(
+    List calls(period);
+    for (int i = 0; i < period; ++i) {
+      calls[i] = makeLogPdfCall(
         logPdf[i % logPdf.size()],
         listToDottedPair(arguments, i)
       );
+    }
 
-      ARMS<double, FunctionWrapper, NumericVector::iterator> dist(
-        f,
-        lower[i % lower.size()],
-        upper[i % upper.size()],
-        convex[i % convex.size()],
-        initialVector.begin(), initialVector.size(),
-        maxPoints[i % maxPoints.size()],
-        metropolis[i % metropolis.size()],
-        previous[i % previous.size()]
-      );
-      samples[i] = dist(rng);
-      nEvaluations += f.nEvaluations();
+    if (nDistributions < nSamples) {
+      Nullable<List> noEnvelope;
+      List unusedEnvelope;
+      for (int k = 0; k < nDistributions; ++k) {
+        NumericVector distributionSamples(
+          (nSamples - k + nDistributions - 1) / nDistributions
+        );
+        Language call = calls[k % period];
+        FunctionWrapper f(call);
+        sampleSingleDistribution(
+          f, rng,
+          lower[k % lower.size()],
+          upper[k % upper.size()],
+          initial[k % initial.size()],
+          convex[k % convex.size()],
+          maxPoints[k % maxPoints.size()],
+          metropolis[k % metropolis.size()],
+          previous[k % previous.size()],
+          autoInitial, prune,
+          noEnvelope, false, distributionSamples, unusedEnvelope, diagnostics
+        );
+        nEvaluations += f.nEvaluations();
+        for (int j = 0; j < distributionSamples.size(); ++j) {
+          samples[k + j * nDistributions] = distributionSamples[j];
+        }
+      }
+    } else {
+      // Every sample has its own distribution. The initial points are
+      // converted once, rather than for every sample
+      std::vector<std::vector<double> > initialValues = initialPoints(initial);
+
+      // Failures end the loop, and are reported once it has finished
+      Status status = Status::SUCCESS;
+      for (int i = 0; i < nSamples && status == Status::SUCCESS; ++i) {
+        Language call = calls[i % period];
+        FunctionWrapper f(call);
+        status = sampleOnce(
+          f, rng,
+          lower[i % lower.size()],
+          upper[i % upper.size()],
+          initialValues[i % initialValues.size()],
+          convex[i % convex.size()],
+          maxPoints[i % maxPoints.size()],
+          metropolis[i % metropolis.size()],
+          previous[i % previous.size()],
+          autoInitial, samples[i], diagnostics
+        );
+        nEvaluations += f.nEvaluations();
+      }
+      if (status != Status::SUCCESS) {
+        stop(statusMessage(status));
+      }
     }
   }
 
-  if (includeNEvaluations) {
+  if (includeNEvaluations || includeDiagnostics || includeEnvelope) {
     List output;
-    output["n_evaluations"] = nEvaluations;
+    if (includeNEvaluations) {
+      output["n_evaluations"] = nEvaluations;
+    }
+    if (includeDiagnostics) {
+      output["diagnostics"] = diagnosticsToList(
+        std::vector<Diagnostics>(1, diagnostics)
+      );
+    }
     output["samples"] = samples;
+    if (includeEnvelope) {
+      output["envelope"] = outputEnvelope;
+    }
     return output;
   } else {
     return samples;
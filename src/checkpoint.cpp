@@ -0,0 +1,27 @@
+#include "checkpoint.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <cstdio>
+#endif
+
+namespace armspp {
+
+bool replaceFile(const std::string& temporaryPath, const std::string& path) {
+#ifdef _WIN32
+  // rename() fails on Windows if the target exists
+  return MoveFileExA(
+    temporaryPath.c_str(),
+    path.c_str(),
+    MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH
+  ) != 0;
+#else
+  // POSIX rename() replaces the target atomically
+  return std::rename(temporaryPath.c_str(), path.c_str()) == 0;
+#endif
+}
+
+}  // namespace armspp
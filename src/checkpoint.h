@@ -0,0 +1,88 @@
+#ifndef SRC_CHECKPOINT_H_
+#define SRC_CHECKPOINT_H_
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <Rcpp.h>
+
+namespace armspp {
+
+// Helpers for the binary checkpoint files written by arms_gibbs. Values are
+// stored in the native byte order, so checkpoints are only meant to be read on
+// the machine that wrote them, or one like it
+
+template<typename T>
+void writeBinary(std::ostream& stream, const T& value) {
+  stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template<typename T>
+T readBinary(std::istream& stream) {
+  T value;
+  stream.read(reinterpret_cast<char*>(&value), sizeof(T));
+  if (!stream) {
+    Rcpp::stop("Checkpoint is truncated");
+  }
+  return value;
+}
+
+inline void writeVector(std::ostream& stream, const std::vector<double>& x) {
+  writeBinary<int32_t>(stream, x.size());
+  if (!x.empty()) {
+    stream.write(reinterpret_cast<const char*>(x.data()), x.size() * sizeof(double));
+  }
+}
+
+inline std::vector<double> readVector(std::istream& stream) {
+  int32_t size = readBinary<int32_t>(stream);
+  if (size < 0) {
+    Rcpp::stop("Checkpoint is corrupt");
+  }
+  std::vector<double> x(size);
+  if (size > 0) {
+    stream.read(reinterpret_cast<char*>(x.data()), size * sizeof(double));
+    if (!stream) {
+      Rcpp::stop("Checkpoint is truncated");
+    }
+  }
+  return x;
+}
+
+// Random number generators are saved using their textual representation,
+// which round trips exactly (as the standard guarantees for its own engines)
+template<typename RNG>
+void writeGenerator(std::ostream& stream, const RNG& rng) {
+  std::ostringstream state;
+  state << rng;
+  std::string text = state.str();
+  writeBinary<int32_t>(stream, text.size());
+  stream.write(text.data(), text.size());
+}
+
+template<typename RNG>
+void readGenerator(std::istream& stream, RNG& rng) {
+  int32_t size = readBinary<int32_t>(stream);
+  if (size < 0) {
+    Rcpp::stop("Checkpoint is corrupt");
+  }
+  std::string text(size, '\0');
+  stream.read(&text[0], size);
+  std::istringstream state(text);
+  state >> rng;
+  if (!stream || !state) {
+    Rcpp::stop("Checkpoint is corrupt");
+  }
+}
+
+// Replaces the file at path by the one at temporaryPath, returning whether it
+// succeeded. The replacement is atomic, so a reader (or an interrupted run)
+// always finds either the old file or the new one
+bool replaceFile(const std::string& temporaryPath, const std::string& path);
+
+}  // namespace armspp
+
+#endif  // SRC_CHECKPOINT_H_
@@ -0,0 +1,49 @@
+#include <Rcpp.h>
+#include <R_ext/Rdynload.h>
+#include <armspp_native>
+
+using namespace Rcpp;
+using armspp::NativeGibbsLogPdfFunction;
+using armspp::NativeGibbsLogPdfWithGradientFunction;
+using armspp::NativeLogPdfFunction;
+using armspp::NativeLogPdfWithGradientFunction;
+using armspp::makeNativeGibbsLogPdf;
+using armspp::makeNativeLogPdf;
+
+// [[Rcpp::export(name = '.native_log_pdf')]]
+SEXP nativeLogPdf(
+  std::string package,
+  std::string name,
+  RObject data,
+  bool gibbs,
+  bool gradient
+) {
+  // R_GetCCallable errors if the function has not been registered
+  DL_FUNC function = R_GetCCallable(package.c_str(), name.c_str());
+  void* nativeData = static_cast<void*>(static_cast<SEXP>(data));
+  if (gibbs && gradient) {
+    return makeNativeGibbsLogPdf(
+      reinterpret_cast<NativeGibbsLogPdfWithGradientFunction>(function),
+      nativeData,
+      data
+    );
+  } else if (gibbs) {
+    return makeNativeGibbsLogPdf(
+      reinterpret_cast<NativeGibbsLogPdfFunction>(function),
+      nativeData,
+      data
+    );
+  } else if (gradient) {
+    return makeNativeLogPdf(
+      reinterpret_cast<NativeLogPdfWithGradientFunction>(function),
+      nativeData,
+      data
+    );
+  } else {
+    return makeNativeLogPdf(
+      reinterpret_cast<NativeLogPdfFunction>(function),
+      nativeData,
+      data
+    );
+  }
+}
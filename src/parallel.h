@@ -0,0 +1,227 @@
+#ifndef SRC_PARALLEL_H_
+#define SRC_PARALLEL_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <armspp>
+
+namespace armspp {
+
+const std::chrono::milliseconds WAIT_INTERVAL(100);
+
+// Generator for the given stream out of several split from one seed, such as
+// one per thread. The streams do not overlap
+inline Xoshiro256PlusPlus streamGenerator(uint_fast64_t seed, int stream) {
+  return Xoshiro256PlusPlus(seed, stream);
+}
+
+// Calls f(thread, begin, end) for each of nThreads contiguous blocks of
+// [0, n), with each block on its own thread. The partition depends only on n
+// and nThreads, so output is reproducible as long as f's behaviour depends
+// only on its arguments. f must not call the R API. While the blocks run, the
+// calling thread calls wait() every WAIT_INTERVAL, for example to report
+// progress; it is not called if there is only one block, which runs on the
+// calling thread. The first exception thrown by any block is rethrown on the
+// calling thread once all blocks are done.
+template<typename F, typename Wait>
+void parallelFor(int n, int nThreads, F f, Wait wait) {
+  if (nThreads > n) nThreads = n;
+  if (nThreads <= 1) {
+    if (n > 0) f(0, 0, n);
+    return;
+  }
+
+  std::vector<std::exception_ptr> errors(nThreads);
+  std::vector<std::thread> threads;
+  std::mutex mutex;
+  std::condition_variable finished;
+  int nFinished = 0;
+  threads.reserve(nThreads);
+  try {
+    for (int thread = 0; thread < nThreads; ++thread) {
+      int begin = static_cast<int>(static_cast<long>(n) * thread / nThreads);
+      int end = static_cast<int>(static_cast<long>(n) * (thread + 1) / nThreads);
+      threads.push_back(std::thread([&, thread, begin, end]() {
+        try {
+          f(thread, begin, end);
+        } catch (...) {
+          errors[thread] = std::current_exception();
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        ++nFinished;
+        finished.notify_one();
+      }));
+    }
+  } catch (...) {
+    // Could not start a thread; wait for those that did start
+    for (std::size_t thread = 0; thread < threads.size(); ++thread) {
+      threads[thread].join();
+    }
+    throw;
+  }
+
+  std::unique_lock<std::mutex> lock(mutex);
+  while (nFinished < nThreads) {
+    finished.wait_for(lock, WAIT_INTERVAL);
+    lock.unlock();
+    wait();
+    lock.lock();
+  }
+  lock.unlock();
+
+  for (int thread = 0; thread < nThreads; ++thread) {
+    threads[thread].join();
+  }
+  for (int thread = 0; thread < nThreads; ++thread) {
+    if (errors[thread]) {
+      std::rethrow_exception(errors[thread]);
+    }
+  }
+}
+
+inline void noWait_() {}
+
+// Threads that together run many short loops, such as one per block of a
+// Gibbs sweep. run(n, f) calls f(thread, begin, end) over the same blocks of
+// [0, n) as parallelFor, with the first block on the calling thread and each
+// other on one of nThreads - 1 workers, started once by the constructor and
+// joined by the destructor; between loops they wait without spinning. f must
+// not call the R API, and the first exception thrown by any block is rethrown
+// by run once all blocks are done.
+class WorkerTeam {
+public:
+  explicit WorkerTeam(int nThreads)
+    : nThreads_(nThreads < 1 ? 1 : nThreads),
+      n_(0),
+      nActive_(0),
+      nRunning_(0),
+      generation_(0),
+      isStopping_(false),
+      errors_(nThreads_) {
+    workers_.reserve(nThreads_ - 1);
+    try {
+      for (int thread = 1; thread < nThreads_; ++thread) {
+        workers_.push_back(std::thread(&WorkerTeam::work_, this, thread));
+      }
+    } catch (...) {
+      // Could not start a thread; stop those that did start
+      stop_();
+      throw;
+    }
+  }
+
+  ~WorkerTeam() {
+    stop_();
+  }
+
+  int nThreads() const { return nThreads_; }
+
+  template<typename F>
+  void run(int n, F f) {
+    int nActive = nThreads_ > n ? n : nThreads_;
+    if (nActive <= 1) {
+      if (n > 0) f(0, 0, n);
+      return;
+    }
+
+    for (int thread = 0; thread < nActive; ++thread) {
+      errors_[thread] = std::exception_ptr();
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      task_ = f;
+      n_ = n;
+      nActive_ = nActive;
+      nRunning_ = nActive - 1;
+      ++generation_;
+    }
+    started_.notify_all();
+    runBlock_(0);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (nRunning_ > 0) {
+      finished_.wait(lock);
+    }
+    task_ = nullptr;
+    lock.unlock();
+
+    for (int thread = 0; thread < nActive; ++thread) {
+      if (errors_[thread]) {
+        std::rethrow_exception(errors_[thread]);
+      }
+    }
+  }
+
+private:
+  int nThreads_;
+  // The loop being run: its length, the number of blocks, and the number of
+  // workers yet to finish theirs
+  std::function<void(int, int, int)> task_;
+  int n_;
+  int nActive_;
+  int nRunning_;
+  // Counts the loops started, so that a worker can tell a new one has
+  unsigned long generation_;
+  bool isStopping_;
+  std::vector<std::exception_ptr> errors_;
+  std::vector<std::thread> workers_;
+  std::mutex mutex_;
+  std::condition_variable started_;
+  std::condition_variable finished_;
+
+  void runBlock_(int thread) {
+    int begin = static_cast<int>(static_cast<long>(n_) * thread / nActive_);
+    int end = static_cast<int>(static_cast<long>(n_) * (thread + 1) / nActive_);
+    try {
+      task_(thread, begin, end);
+    } catch (...) {
+      errors_[thread] = std::current_exception();
+    }
+  }
+
+  void work_(int thread) {
+    unsigned long seen = 0;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      while (!isStopping_ && generation_ == seen) {
+        started_.wait(lock);
+      }
+      if (isStopping_) return;
+      seen = generation_;
+      if (thread >= nActive_) continue;
+
+      lock.unlock();
+      runBlock_(thread);
+      lock.lock();
+      if (--nRunning_ == 0) {
+        finished_.notify_one();
+      }
+    }
+  }
+
+  void stop_() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      isStopping_ = true;
+    }
+    started_.notify_all();
+    for (std::size_t thread = 0; thread < workers_.size(); ++thread) {
+      workers_[thread].join();
+    }
+  }
+};
+
+template<typename F>
+void parallelFor(int n, int nThreads, F f) {
+  parallelFor(n, nThreads, f, noWait_);
+}
+
+};
+
+#endif  // SRC_PARALLEL_H_
@@ -1,76 +1,102 @@
 #ifndef SRC_PROGRESS_HPP_
 #define SRC_PROGRESS_HPP_
 
+#include <atomic>
 #include <chrono>
 #include <cstdint>
-#include <sstream>
+#include <cstdio>
+#include <thread>
 #include <Rcpp.h>
 
 namespace armspp {
 
+// The bar is drawn at most this often, apart from once all steps are done
+const std::chrono::milliseconds PROGRESS_INTERVAL(100);
+
+// Counts steps towards nSteps and shows the count, rate and time remaining.
+// Steps may be counted from any thread, for example by parallel chains
+// reporting into one bar, but the bar is only drawn from the thread that
+// created it, which must be the R main thread. Counting a step there only
+// reads the clock, unless PROGRESS_INTERVAL has passed since the bar was last
+// drawn
 class ProgressBar {
  public:
     explicit ProgressBar(uint64_t nSteps)
         : nSteps_(nSteps),
           currentStep_(0),
-          lastCheckStep_(0),
-          lastCheckStepTime_(0),
-          lastOutputLength_(0) {
-        lastCheckTime_ = std::chrono::system_clock::now();
+          owner_(std::this_thread::get_id()),
+          lastOutputStep_(0),
+          lastOutputLength_(0),
+          isFinished_(false) {
+        lastOutputTime_ = std::chrono::steady_clock::now();
     }
 
     uint64_t operator+=(uint64_t increment) {
-        currentStep_ += increment;
-        output();
-        return currentStep_;
+        uint64_t step = currentStep_.fetch_add(
+            increment, std::memory_order_relaxed
+        ) + increment;
+        if (std::this_thread::get_id() == owner_) {
+            update();
+        }
+        return step;
     }
 
     uint64_t operator++() {
-        currentStep_ += 1;
-        output();
-        return currentStep_;
+        return *this += 1;
     }
 
- private:
-    uint64_t nSteps_;
-    uint64_t currentStep_;
-
-    uint64_t lastCheckStep_;
-    std::chrono::time_point<std::chrono::system_clock> lastCheckTime_;
-    double lastCheckStepTime_;
-    unsigned int lastOutputLength_;
-
-    void output() {
-        unsigned int percent = 100 * currentStep_ / nSteps_;
+    // Draws the bar if it is due, for example while other threads count the
+    // steps. Must be called from the thread that created the bar
+    void update() {
+        uint64_t step = currentStep_.load(std::memory_order_relaxed);
+        if (isFinished_ || step == lastOutputStep_) return;
 
-        if (currentStep_ == 1 || currentStep_ % 100 == 0) {
-            std::chrono::time_point<std::chrono::system_clock> now = std::chrono::system_clock::now();
-            std::chrono::duration<double> elapsedSeconds = now - lastCheckTime_;
-            lastCheckStepTime_ = 1000 * elapsedSeconds.count() / (currentStep_ - lastCheckStep_);
-
-            lastCheckStep_ = currentStep_;
-            lastCheckTime_ = now;
-        }
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (step < nSteps_ && now - lastOutputTime_ < PROGRESS_INTERVAL) return;
+        output(step, now);
+    }
 
-        // Write out a string of spaces to overwrite the last output, because the
-        // internal R terminal doesn't support ANSI codes
-        Rcpp::Rcout << "\r";
-        for (unsigned int i = 0; i < lastOutputLength_; ++i) {
+ private:
+    uint64_t nSteps_;
+    std::atomic<uint64_t> currentStep_;
+    std::thread::id owner_;
+
+    uint64_t lastOutputStep_;
+    std::chrono::steady_clock::time_point lastOutputTime_;
+    int lastOutputLength_;
+    bool isFinished_;
+
+    void output(uint64_t step, std::chrono::steady_clock::time_point now) {
+        // The rate is measured since the bar was last drawn
+        std::chrono::duration<double, std::milli> elapsed = now - lastOutputTime_;
+        double stepTime = elapsed.count() / (step - lastOutputStep_);
+        uint64_t remaining = step < nSteps_ ? nSteps_ - step : 0;
+        unsigned int percent = nSteps_ > 0 ? 100 * step / nSteps_ : 100;
+
+        char text[128];
+        int length = std::snprintf(
+            text, sizeof(text),
+            "%llu/%llu (%u%%) %.2fms/iteration (%.2fs remaining)",
+            static_cast<unsigned long long>(step),
+            static_cast<unsigned long long>(nSteps_),
+            percent,
+            stepTime,
+            remaining * stepTime / 1000
+        );
+
+        // Pad with spaces to overwrite the last output, because the internal
+        // R terminal doesn't support ANSI codes
+        Rcpp::Rcout << "\r" << text;
+        for (int i = length; i < lastOutputLength_; ++i) {
             Rcpp::Rcout << " ";
         }
+        lastOutputLength_ = length;
+        lastOutputStep_ = step;
+        lastOutputTime_ = now;
 
-        std::ostringstream sstream;
-        sstream << std::fixed << std::setprecision(2)
-            << "\r"
-            << currentStep_ << "/" << nSteps_ << " (" << percent << "%)"
-            << " " << lastCheckStepTime_ << "ms/iteration"
-            << " (" << ((nSteps_ - currentStep_) * lastCheckStepTime_) / 1000 << "s remaining)";
-        std::string output = sstream.str();
-        lastOutputLength_ = output.length();
-        Rcpp::Rcout << output;
-
-        if (currentStep_ == nSteps_) {
+        if (step >= nSteps_) {
             Rcpp::Rcout << "\n";
+            isFinished_ = true;
         }
 
         Rcpp::Rcout.flush();
@@ -1,5 +1,9 @@
 #include "utils.h"
 
+#include <algorithm>
+#include <cmath>
+#include <complex>
+
 using namespace Rcpp;
 
 namespace armspp {
@@ -29,4 +33,154 @@ DottedPair listToDottedPair(List input, int index) {
   return output;
 }
 
+List envelopeToList(const FrozenEnvelope<double>& envelope) {
+  return List::create(
+    Named("x") = wrap(envelope.x()),
+    Named("y") = wrap(envelope.y()),
+    Named("evaluated") = wrap(envelope.isEvaluated())
+  );
+}
+
+FrozenEnvelope<double> listToEnvelope(List input) {
+  NumericVector x = input["x"];
+  NumericVector y = input["y"];
+  LogicalVector evaluated = input["evaluated"];
+
+  return FrozenEnvelope<double>(
+    std::vector<double>(x.begin(), x.end()),
+    std::vector<double>(y.begin(), y.end()),
+    std::vector<bool>(evaluated.begin(), evaluated.end())
+  );
+}
+
+List diagnosticsToList(const std::vector<Diagnostics>& diagnostics) {
+  int n = diagnostics.size();
+  NumericVector nSqueezeAccepted(n);
+  NumericVector nDensityAccepted(n);
+  NumericVector nRejected(n);
+  NumericVector nMetropolisRejected(n);
+  NumericVector nPointsAdded(n);
+  NumericVector nPointsDropped(n);
+  NumericVector nPointsPruned(n);
+  NumericVector iterationsPerSample(n);
+  for (int i = 0; i < n; ++i) {
+    const Diagnostics& d = diagnostics[i];
+    nSqueezeAccepted[i] = d.nSqueezeAccepted;
+    nDensityAccepted[i] = d.nDensityAccepted;
+    nRejected[i] = d.nRejected;
+    nMetropolisRejected[i] = d.nMetropolisRejected;
+    nPointsAdded[i] = d.nPointsAdded;
+    nPointsDropped[i] = d.nPointsDropped;
+    nPointsPruned[i] = d.nPointsPruned;
+    iterationsPerSample[i] = d.nSamples() > 0
+      ? static_cast<double>(d.nProposals()) / d.nSamples()
+      : NA_REAL;
+  }
+
+  return List::create(
+    Named("n_squeeze_accepted") = nSqueezeAccepted,
+    Named("n_density_accepted") = nDensityAccepted,
+    Named("n_rejected") = nRejected,
+    Named("n_metropolis_rejected") = nMetropolisRejected,
+    Named("n_points_added") = nPointsAdded,
+    Named("n_points_dropped") = nPointsDropped,
+    Named("n_points_pruned") = nPointsPruned,
+    Named("iterations_per_sample") = iterationsPerSample
+  );
+}
+
+// Replaces x, whose size must be a power of two, by its discrete Fourier
+// transform, or with inverse by the unnormalised inverse transform
+void fourierTransform(std::vector<std::complex<double> >& x, bool inverse) {
+  std::size_t n = x.size();
+  for (std::size_t i = 1, j = 0; i < n; ++i) {
+    std::size_t bit = n >> 1;
+    for (; j & bit; bit >>= 1) {
+      j ^= bit;
+    }
+    j ^= bit;
+    if (i < j) std::swap(x[i], x[j]);
+  }
+  const double pi = 3.141592653589793238462643383279502884;
+  for (std::size_t length = 2; length <= n; length <<= 1) {
+    double angle = 2 * pi / length * (inverse ? 1 : -1);
+    std::complex<double> step(std::cos(angle), std::sin(angle));
+    for (std::size_t first = 0; first < n; first += length) {
+      std::complex<double> twiddle(1, 0);
+      for (std::size_t k = 0; k < length / 2; ++k) {
+        std::complex<double> even = x[first + k];
+        std::complex<double> odd = x[first + k + length / 2] * twiddle;
+        x[first + k] = even + odd;
+        x[first + k + length / 2] = even - odd;
+        twiddle *= step;
+      }
+    }
+  }
+}
+
+// Autocovariances at lags below this are summed directly by
+// effectiveSampleSize, and beyond it found by FFT
+const int MAX_DIRECT_LAGS = 128;
+
+// Uses the initial monotone sequence estimator of Geyer (1992): the
+// autocorrelations are summed in pairs of consecutive lags for as long as the
+// pairs stay positive, with each pair capped at the one before. The first
+// MAX_DIRECT_LAGS autocovariances are summed directly, which is fastest for a
+// chain that mixes well; if more are needed, all of them are found together
+// by FFT, so a slowly mixing chain takes O(n log n) time rather than O(n^2)
+double effectiveSampleSize(const double* x, int n, long stride) {
+  if (n < 2) return NA_REAL;
+  std::vector<double> centred(n);
+  double mean = 0;
+  for (int t = 0; t < n; ++t) {
+    mean += x[t * stride];
+  }
+  mean /= n;
+  for (int t = 0; t < n; ++t) {
+    centred[t] = x[t * stride] - mean;
+  }
+
+  // Padded with zeros so that the chain does not wrap around. The inverse
+  // transform is unnormalised, so it is divided by its size
+  std::vector<std::complex<double> > transform;
+  auto autocovariance = [&](int lag) {
+    if (lag < MAX_DIRECT_LAGS) {
+      double sum = 0;
+      for (int t = 0; t + lag < n; ++t) {
+        sum += centred[t] * centred[t + lag];
+      }
+      return sum / n;
+    }
+    if (transform.empty()) {
+      std::size_t size = 1;
+      while (size < 2 * static_cast<std::size_t>(n)) {
+        size <<= 1;
+      }
+      transform.assign(centred.begin(), centred.end());
+      transform.resize(size);
+      fourierTransform(transform, false);
+      for (std::size_t k = 0; k < size; ++k) {
+        transform[k] = std::norm(transform[k]);
+      }
+      fourierTransform(transform, true);
+    }
+    return transform[lag].real() / (static_cast<double>(transform.size()) * n);
+  };
+  double variance = autocovariance(0);
+  if (!(variance > 0)) return NA_REAL;
+
+  double time = -1;
+  double previousPair = 2;
+  for (int lag = 0; lag + 1 < n; lag += 2) {
+    double pair = (
+      (lag == 0 ? variance : autocovariance(lag)) + autocovariance(lag + 1)
+    ) / variance;
+    if (pair <= 0) break;
+    pair = std::min(pair, previousPair);
+    time += 2 * pair;
+    previousPair = pair;
+  }
+  return n / std::max(time, 1. / n);
+}
+
 };
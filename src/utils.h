@@ -1,7 +1,24 @@
+#ifndef SRC_UTILS_H_
+#define SRC_UTILS_H_
+
 #include <Rcpp.h>
+#include <vector>
+#include <armspp>
 
 namespace armspp {
 
 Rcpp::DottedPair listToDottedPair(Rcpp::List input, int index);
 
+Rcpp::List envelopeToList(const FrozenEnvelope<double>& envelope);
+FrozenEnvelope<double> listToEnvelope(Rcpp::List input);
+
+// The counts of each element of diagnostics, as a list of vectors
+Rcpp::List diagnosticsToList(const std::vector<Diagnostics>& diagnostics);
+
+// The effective sample size of the chain x[0], x[stride], ... of length n, or
+// NA if it does not vary
+double effectiveSampleSize(const double* x, int n, long stride);
+
 };
+
+#endif  // SRC_UTILS_H_